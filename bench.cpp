@@ -0,0 +1,1002 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "generator.hpp"
+#include "graph.hpp"
+#include "item.hpp"
+#include "levelqueue.hpp"
+#include "map.hpp"
+#include "pathfinder.hpp"
+#include "player.hpp"
+#include "threadpool.hpp"
+
+
+// Every heap allocation made by the benchmarks, for reporting allocation
+// counts alongside timings.
+static std::atomic<unsigned long> allocations(0);
+
+void *
+operator new (std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void *ptr = std::malloc(size != 0 ? size : 1);
+    if (ptr == NULL) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void
+operator delete (void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+
+// The seed every benchmark's random input is derived from, so that runs
+// can be compared.
+static const unsigned int SEED = 1;
+
+
+/*
+ * Suite
+ *
+ * Collects timed samples and counters for named benchmarks, and reports
+ * their statistics as a table or as JSON. Benchmarks are kept in the order
+ * they were first recorded.
+ */
+class Suite
+{
+    public:
+        Suite(unsigned int reps, double max_seconds, const char *filter)
+            : m_reps(reps), m_maxSeconds(max_seconds), m_filter(filter),
+              m_failed(false)
+        {
+        }
+
+        // Whether the filter given on the command line selects a benchmark.
+        bool Wants(const std::string &name) const
+        {
+            return m_filter == NULL || name.find(m_filter) != std::string::npos;
+        }
+
+        // Time fn up to the configured number of repetitions, stopping early
+        // once the time limit for a benchmark is used up.
+        void Measure(const std::string &name, const std::function<void()> &fn)
+        {
+            if (!Wants(name)) {
+                return;
+            }
+
+            double total = 0;
+            for (unsigned int rep = 0; rep < m_reps && total < m_maxSeconds;
+                 rep++) {
+                auto start = std::chrono::steady_clock::now();
+                fn();
+                std::chrono::duration<double> elapsed =
+                    std::chrono::steady_clock::now() - start;
+
+                Record(name, elapsed.count());
+                total += elapsed.count();
+            }
+        }
+
+        void Record(const std::string &name, double seconds)
+        {
+            Get(name).samples.push_back(seconds);
+        }
+
+        void Counter(const std::string &name, const std::string &counter,
+                     double value)
+        {
+            if (!Wants(name)) {
+                return;
+            }
+            Get(name).counters[counter] = value;
+        }
+
+        unsigned int Reps() const
+        {
+            return m_reps;
+        }
+
+        // Note that a benchmark's check of its results failed, which fails
+        // the run.
+        void Fail(const std::string &name, const std::string &message)
+        {
+            std::cerr << name << ": " << message << std::endl;
+            m_failed = true;
+        }
+
+        bool Failed() const
+        {
+            return m_failed;
+        }
+
+        void Report(std::ostream &out) const
+        {
+            out << std::left << std::setw(40) << "benchmark" << std::right
+                << std::setw(6) << "reps" << std::setw(12) << "min ms"
+                << std::setw(12) << "median ms" << std::setw(12) << "mean ms"
+                << std::setw(12) << "stddev ms" << std::endl;
+
+            for (auto &&result : m_results) {
+                Stats stats = Summarise(result.samples);
+
+                out << std::left << std::setw(40) << result.name << std::right
+                    << std::setw(6) << result.samples.size() << std::fixed
+                    << std::setprecision(3)
+                    << std::setw(12) << stats.min * 1000.0
+                    << std::setw(12) << stats.median * 1000.0
+                    << std::setw(12) << stats.mean * 1000.0
+                    << std::setw(12) << stats.stddev * 1000.0;
+                out.unsetf(std::ios::floatfield);
+                out << std::setprecision(6);
+
+                for (auto &&counter : result.counters) {
+                    out << "  " << counter.first << "=" << counter.second;
+                }
+                out << std::endl;
+            }
+        }
+
+        void WriteJson(std::ostream &out) const
+        {
+            out << "{\n  \"seed\": " << SEED << ",\n  \"benchmarks\": [";
+
+            for (std::size_t i = 0; i < m_results.size(); i++) {
+                const Result &result = m_results[i];
+                Stats         stats = Summarise(result.samples);
+
+                out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \""
+                    << result.name << "\", \"reps\": "
+                    << result.samples.size() << ", \"unit\": \"s\""
+                    << std::setprecision(9)
+                    << ", \"min\": " << stats.min
+                    << ", \"median\": " << stats.median
+                    << ", \"mean\": " << stats.mean
+                    << ", \"stddev\": " << stats.stddev
+                    << ", \"samples\": [";
+                for (std::size_t j = 0; j < result.samples.size(); j++) {
+                    out << (j == 0 ? "" : ", ") << result.samples[j];
+                }
+                out << "], \"counters\": {";
+
+                bool first = true;
+                for (auto &&counter : result.counters) {
+                    out << (first ? "" : ", ") << "\"" << counter.first
+                        << "\": " << counter.second;
+                    first = false;
+                }
+                out << "}}";
+            }
+
+            out << "\n  ]\n}" << std::endl;
+        }
+
+    private:
+        struct Result
+        {
+            std::string                   name;
+            std::vector<double>           samples;
+            std::map<std::string, double> counters;
+        };
+
+        struct Stats
+        {
+            double min;
+            double median;
+            double mean;
+            double stddev;
+        };
+
+        Result & Get(const std::string &name)
+        {
+            auto iter = m_index.find(name);
+            if (iter != m_index.end()) {
+                return m_results[iter->second];
+            }
+
+            m_index[name] = m_results.size();
+            m_results.push_back(Result());
+            m_results.back().name = name;
+            return m_results.back();
+        }
+
+        static Stats Summarise(std::vector<double> samples)
+        {
+            Stats stats = { 0, 0, 0, 0 };
+            if (samples.empty()) {
+                return stats;
+            }
+
+            std::sort(samples.begin(), samples.end());
+            std::size_t count = samples.size();
+
+            stats.min = samples.front();
+            stats.median = count % 2 == 1 ?
+                samples[count / 2] :
+                (samples[count / 2 - 1] + samples[count / 2]) / 2.0;
+
+            for (auto sample : samples) {
+                stats.mean += sample;
+            }
+            stats.mean /= count;
+
+            for (auto sample : samples) {
+                stats.stddev += (sample - stats.mean) * (sample - stats.mean);
+            }
+            stats.stddev = count > 1 ? std::sqrt(stats.stddev / (count - 1)) : 0;
+
+            return stats;
+        }
+
+        unsigned int                       m_reps;
+        double                             m_maxSeconds;
+        const char                        *m_filter;
+        bool                               m_failed;
+        std::vector<Result>                m_results;
+        std::map<std::string, std::size_t> m_index;
+};
+
+
+/*
+ * randomPoints
+ *
+ * A fixed set of points scattered over a square of map-like size.
+ */
+static std::vector<graph::Vec2f>
+randomPoints (unsigned int count)
+{
+    std::mt19937                          random_gen(SEED);
+    std::uniform_real_distribution<float> coord_dis(0.0f, 4096.0f);
+    std::vector<graph::Vec2f>             points;
+
+    for (unsigned int i = 0; i < count; i++) {
+        float x = coord_dis(random_gen);
+        float y = coord_dis(random_gen);
+        points.push_back(graph::Vec2f(x, y));
+    }
+
+    return points;
+}
+
+
+/*
+ * benchGraph
+ *
+ * Triangulate sets of 10 up to max_points points, derive each graph of them
+ * from the triangulation, and move points around in it.
+ */
+static void
+benchGraph (Suite &suite, unsigned int max_points)
+{
+    const std::pair<const char *, graph::GraphType> graphs[] = {
+        { "gabriel", graph::GABRIEL },
+        { "urquhart", graph::URQUHART },
+        { "rng", graph::RELATIVE_NEIGHBOURHOOD },
+        { "mst", graph::SPANNING_TREE },
+    };
+
+    for (unsigned int count = 10; count <= max_points; count *= 10) {
+        std::vector<graph::Vec2f> points = randomPoints(count);
+        std::string               size = std::to_string(count);
+        std::size_t               tris = 0;
+
+        suite.Measure("graph/delaunay/" + size, [&] {
+            tris = graph::Triangulation(points).GetTriangles().size();
+        });
+        suite.Counter("graph/delaunay/" + size, "triangles", tris);
+
+        graph::Triangulation tri(points);
+        for (auto &&type : graphs) {
+            std::string name = std::string("graph/") + type.first + "/" + size;
+            std::size_t edges = 0;
+
+            suite.Measure(name, [&] {
+                edges = graph::generateGraph(tri, type.second).size();
+            });
+            suite.Counter(name, "edges", edges);
+        }
+
+        // Move points one at a time, keeping the Urquhart graph up to date.
+        const unsigned int MOVES = 100;
+        std::mt19937                          random_gen(SEED);
+        std::uniform_real_distribution<float> coord_dis(0.0f, 4096.0f);
+        std::size_t                           changed = 0;
+
+        suite.Measure("graph/move/" + size, [&] {
+            graph::Triangulation::UrquhartChange change;
+            changed = 0;
+            for (unsigned int i = 0; i < MOVES; i++) {
+                std::uint32_t point = random_gen() % count;
+                tri.Move(point,
+                         graph::Vec2f(coord_dis(random_gen),
+                                      coord_dis(random_gen)),
+                         &change);
+                changed += change.removed.size() + change.added.size();
+            }
+        });
+        suite.Counter("graph/move/" + size, "moves", MOVES);
+        suite.Counter("graph/move/" + size, "changed_edges", changed);
+
+        // Apply the changes of more moves to the graph as it was, and check
+        // it against the graph built from scratch every few moves. A missed
+        // change stays missing, so this need not rebuild after every move.
+        const std::string check_name = "graph/move/" + size + "/check";
+        if (suite.Wants(check_name)) {
+            const unsigned int CHECK_INTERVAL = 10;
+            std::vector<graph::IndexedEdge> edges =
+                graph::generateGraph(tri, graph::URQUHART);
+            std::set<graph::IndexedEdge>    moved(edges.begin(), edges.end());
+            std::size_t                     mismatches = 0;
+            auto                            start =
+                std::chrono::steady_clock::now();
+
+            for (unsigned int i = 0; i < MOVES; i++) {
+                graph::Triangulation::UrquhartChange change;
+                std::uint32_t point = random_gen() % count;
+                tri.Move(point,
+                         graph::Vec2f(coord_dis(random_gen),
+                                      coord_dis(random_gen)),
+                         &change);
+
+                for (auto &&edge : change.removed) {
+                    moved.erase(edge);
+                }
+                moved.insert(change.added.begin(), change.added.end());
+
+                if ((i + 1) % CHECK_INTERVAL != 0) {
+                    continue;
+                }
+
+                edges = graph::generateGraph(tri, graph::URQUHART);
+                if (std::set<graph::IndexedEdge>(edges.begin(), edges.end()) !=
+                    moved) {
+                    mismatches++;
+                }
+            }
+
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            suite.Record(check_name, elapsed.count());
+            suite.Counter(check_name, "moves", MOVES);
+            suite.Counter(check_name, "mismatches", mismatches);
+            if (mismatches != 0) {
+                suite.Fail(check_name,
+                           "the moved Urquhart graph differs from a rebuilt one");
+            }
+        }
+    }
+}
+
+
+/*
+ * benchVisibility
+ *
+ * Check line of sight from a few positions of a fixed level to every tile in
+ * sight range, update the level's visibility from the same positions, and
+ * update it as a door near each is opened and closed. Check line of sight
+ * against the traced rays from every tile that can be stood on. Then build
+ * the level's visibility sets and update the visibility from them.
+ */
+static void
+benchVisibility (Suite &suite)
+{
+    const unsigned int SIGHT_RADIUS = 16;
+
+    dungeon::GeneratorParams params;
+    dungeon::Generator       generator(params, SEED);
+    generator.Run();
+    std::shared_ptr<dungeon::Map> map = generator.GetMap();
+
+    // The spawn point and the middle of the first few rooms.
+    std::vector<std::pair<unsigned int, unsigned int>> positions;
+    unsigned int spawn_x, spawn_y;
+    if (map->FindSpawn(&spawn_x, &spawn_y)) {
+        positions.push_back(std::make_pair(spawn_x, spawn_y));
+    }
+    for (auto &&room : map->GetRooms()) {
+        if (positions.size() == 4) {
+            break;
+        }
+        positions.push_back(std::make_pair(room.CenterX(), room.CenterY()));
+    }
+
+    int r = static_cast<int>(SIGHT_RADIUS);
+    for (std::size_t i = 0; i < positions.size(); i++) {
+        int         x = static_cast<int>(positions[i].first);
+        int         y = static_cast<int>(positions[i].second);
+        std::string pos = "pos" + std::to_string(i);
+        std::size_t visible = 0;
+
+        // The traced rays read the tiles around their ends, so the tiles on
+        // the edge of the map are left out.
+        auto countVisible = [&](bool traced) {
+            visible = 0;
+            for (int tile_y = std::max(y - r, 1);
+                 tile_y <= std::min(y + r, static_cast<int>(map->Height()) - 2);
+                 tile_y++) {
+                for (int tile_x = std::max(x - r, 1);
+                     tile_x <= std::min(x + r, static_cast<int>(map->Width()) - 2);
+                     tile_x++) {
+                    if (traced ? map->IsVisibleTraced(x, y, tile_x, tile_y) :
+                                 map->IsVisible(x, y, tile_x, tile_y)) {
+                        visible++;
+                    }
+                }
+            }
+        };
+
+        suite.Measure("map/is_visible/" + pos, [&] { countVisible(false); });
+        suite.Counter("map/is_visible/" + pos, "visible", visible);
+        suite.Measure("map/is_visible_traced/" + pos, [&] {
+            countVisible(true);
+        });
+        suite.Counter("map/is_visible_traced/" + pos, "visible", visible);
+
+        suite.Measure("map/update_visibility/" + pos, [&] {
+            map->ResetVisibility();
+            map->UpdateVisibility(x, y, SIGHT_RADIUS);
+        });
+
+        // Open and close the nearest door in sight range, as the player
+        // would, updating the view after each.
+        std::size_t door = map->TileCount();
+        int         door_dist = r * r + 1;
+        for (int tile_y = std::max(y - r, 0);
+             tile_y <= std::min(y + r, static_cast<int>(map->Height()) - 1);
+             tile_y++) {
+            for (int tile_x = std::max(x - r, 0);
+                 tile_x <= std::min(x + r, static_cast<int>(map->Width()) - 1);
+                 tile_x++) {
+                dungeon::Tile::TileType type = map->GetType(tile_x, tile_y);
+                int dist = (x - tile_x) * (x - tile_x) +
+                           (y - tile_y) * (y - tile_y);
+                if ((type == dungeon::Tile::DOOR_OPEN ||
+                     type == dungeon::Tile::DOOR_CLOSED) && dist < door_dist) {
+                    door = map->TileIndex(tile_x, tile_y);
+                    door_dist = dist;
+                }
+            }
+        }
+
+        if (door != map->TileCount()) {
+            dungeon::Tile::TileType type = map->GetType(door);
+            map->UpdateVisibility(x, y, SIGHT_RADIUS);
+            suite.Measure("map/door/" + pos, [&] {
+                for (unsigned int i = 0; i < 2; i++) {
+                    map->SetType(door, map->GetType(door) ==
+                                       dungeon::Tile::DOOR_OPEN ?
+                                       dungeon::Tile::DOOR_CLOSED :
+                                       dungeon::Tile::DOOR_OPEN);
+                    map->InvalidateVisibility(door);
+                    map->UpdateVisibility(x, y, SIGHT_RADIUS);
+                }
+            });
+            map->SetType(door, type);
+            map->ResetVisibility();
+        }
+    }
+
+    // Check line of sight between every tile that can be stood on and every
+    // tile in sight range of it against the traced rays, away from the edge
+    // of the map.
+    const std::string check_name = "map/is_visible/check";
+    if (suite.Wants(check_name)) {
+        std::size_t pairs = 0;
+        std::size_t mismatches = 0;
+        auto        start = std::chrono::steady_clock::now();
+
+        for (int y = 1; y < static_cast<int>(map->Height()) - 1; y++) {
+            for (int x = 1; x < static_cast<int>(map->Width()) - 1; x++) {
+                dungeon::Tile::TileType type = map->GetType(x, y);
+                if (dungeon::Tile::BlocksVisibility(type) &&
+                    type != dungeon::Tile::DOOR_CLOSED) {
+                    continue;
+                }
+
+                for (int tile_y = std::max(y - r, 1);
+                     tile_y <= std::min(y + r,
+                                        static_cast<int>(map->Height()) - 2);
+                     tile_y++) {
+                    for (int tile_x = std::max(x - r, 1);
+                         tile_x <= std::min(x + r,
+                                            static_cast<int>(map->Width()) - 2);
+                         tile_x++) {
+                        pairs++;
+                        if (map->IsVisible(x, y, tile_x, tile_y) !=
+                            map->IsVisibleTraced(x, y, tile_x, tile_y)) {
+                            mismatches++;
+                        }
+                    }
+                }
+            }
+        }
+
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        suite.Record(check_name, elapsed.count());
+        suite.Counter(check_name, "pairs", pairs);
+        suite.Counter(check_name, "mismatches", mismatches);
+        if (mismatches != 0) {
+            suite.Fail(check_name, "IsVisible disagrees with the traced rays");
+        }
+    }
+
+    // Build the level's visibility sets, and look the views up in them with
+    // every door open.
+    dungeon::Map open_map(*map);
+    for (std::size_t i = 0; i < open_map.TileCount(); i++) {
+        if (open_map.GetType(i) == dungeon::Tile::DOOR_CLOSED) {
+            open_map.SetType(i, dungeon::Tile::DOOR_OPEN);
+        }
+    }
+
+    suite.Measure("map/build_visibility_sets", [&] {
+        open_map.BuildVisibilitySets(SIGHT_RADIUS);
+    });
+    if (open_map.VisibilitySetRadius() == 0) {
+        return;
+    }
+    suite.Counter("map/build_visibility_sets", "bytes",
+                  open_map.VisibilitySetWords() * sizeof(std::uint64_t));
+
+    for (std::size_t i = 0; i < positions.size(); i++) {
+        std::string pos = "pos" + std::to_string(i);
+        suite.Measure("map/visibility_set/" + pos, [&] {
+            open_map.ResetVisibility();
+            open_map.UpdateVisibility(positions[i].first, positions[i].second,
+                                      SIGHT_RADIUS);
+        });
+    }
+}
+
+
+/*
+ * benchObservers
+ *
+ * Find the fields of view of a turn's worth of monsters spread over a fixed
+ * level, on this thread and across a pool, then again with the level's
+ * visibility sets built for the monsters' sight radius.
+ */
+static void
+benchObservers (Suite &suite, std::size_t count)
+{
+    const unsigned int SIGHT_RADIUS = 8;
+
+    dungeon::GeneratorParams params;
+    dungeon::Generator       generator(params, SEED);
+    generator.Run();
+    dungeon::Map map(*generator.GetMap());
+
+    std::vector<std::size_t> floors;
+    for (std::size_t i = 0; i < map.TileCount(); i++) {
+        if (map.GetType(i) == dungeon::Tile::FLOOR) {
+            floors.push_back(i);
+        }
+    }
+    if (floors.empty()) {
+        return;
+    }
+
+    std::mt19937                   rng(SEED);
+    std::vector<dungeon::Observer> observers(count);
+    for (auto &&o : observers) {
+        std::size_t tile = floors[rng() % floors.size()];
+        o.x = map.TileX(tile);
+        o.y = map.TileY(tile);
+        o.radius = SIGHT_RADIUS;
+    }
+
+    util::ThreadPool       pool;
+    dungeon::ObserverViews views;
+    std::string            size = std::to_string(count);
+
+    auto measure = [&](const std::string &name, util::ThreadPool *threads) {
+        suite.Measure(name, [&] {
+            map.FindViews(observers, &views, threads);
+        });
+
+        std::size_t visible = 0;
+        for (std::size_t i = 0; i < views.Size(); i++) {
+            visible += views.Count(i);
+        }
+        suite.Counter(name, "visible_per_observer",
+                      static_cast<double>(visible) / count);
+    };
+
+    measure("map/views/" + size, NULL);
+    measure("map/views/" + size + "/threads", &pool);
+
+    map.BuildVisibilitySets(SIGHT_RADIUS, &pool);
+    measure("map/views/" + size + "/sets", NULL);
+    measure("map/views/" + size + "/sets/threads", &pool);
+}
+
+
+/*
+ * benchGenerator
+ *
+ * Generate levels of a given size a stage at a time, timing each stage and
+ * the whole run.
+ */
+static void
+benchGenerator (Suite &suite, unsigned int width, unsigned int height,
+                unsigned int rooms)
+{
+    std::string size = std::to_string(width) + "x" + std::to_string(height);
+    std::string full = "generator/full/" + size;
+
+    dungeon::GeneratorParams params;
+    params.width = width;
+    params.height = height;
+    params.rooms = rooms;
+
+    // The stage names are only known once the generator reaches each stage,
+    // so a level is always generated once to see if any are wanted.
+    bool   wanted = suite.Wants(full);
+    double total = 0;
+    for (unsigned int rep = 0; rep < suite.Reps(); rep++) {
+        dungeon::Generator generator(params, dungeon::DeriveSeed(SEED, rep));
+        double             elapsed_total = 0;
+
+        while (!generator.IsFinished()) {
+            // Stage names are for display, so turn "Create walls" into
+            // "create_walls".
+            std::string stage = generator.StageName();
+            for (auto &&c : stage) {
+                c = c == ' ' ? '_' : static_cast<char>(std::tolower(c));
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            generator.Iterate();
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+
+            std::string name = "generator/stage/" + size + "/" + stage;
+            if (suite.Wants(name)) {
+                suite.Record(name, elapsed.count());
+                wanted = true;
+            }
+            elapsed_total += elapsed.count();
+        }
+
+        if (suite.Wants(full)) {
+            suite.Record(full, elapsed_total);
+        }
+
+        // Keep large levels from taking over the whole run.
+        total += elapsed_total;
+        if (!wanted || total > 10.0) {
+            break;
+        }
+    }
+}
+
+
+/*
+ * benchRouter
+ *
+ * Route the same set of random start/goal pairs across a width x height grid
+ * with a given method, counting node expansions and the average corridor
+ * length.
+ */
+static void
+benchRouter (Suite                      &suite,
+             const char                 *method_name,
+             dungeon::PathFinder::Method method,
+             unsigned int                width,
+             unsigned int                height,
+             unsigned int                paths)
+{
+    std::string name = std::string("router/") + method_name + "/" +
+                       std::to_string(width) + "x" + std::to_string(height);
+
+    dungeon::PathFinder       finder;
+    dungeon::PathFinder::Path path;
+    unsigned long             length = 0;
+
+    finder.Resize(width, height);
+    finder.SetMethod(method);
+
+    suite.Measure(name, [&] {
+        std::mt19937                                 random_gen(SEED);
+        std::uniform_int_distribution<std::uint32_t> tile_dis(
+                                                    0, width * height - 1);
+
+        finder.ResetStats();
+        length = 0;
+        for (unsigned int i = 0; i < paths; i++) {
+            std::uint32_t from = tile_dis(random_gen);
+            std::uint32_t to = tile_dis(random_gen);
+
+            finder.FindPath(from, to, path);
+            length += path.size() + 1;
+        }
+    });
+
+    suite.Counter(name, "paths", paths);
+    suite.Counter(name, "expansions_per_path",
+                  static_cast<double>(finder.GetStats().expansions) / paths);
+    suite.Counter(name, "tiles_per_path",
+                  static_cast<double>(length) / paths);
+}
+
+
+/*
+ * benchItems
+ *
+ * Create a number of levels' worth of items and pick them all up, once with
+ * an individually allocated, reference counted item per slot, as the game
+ * used to, and once with a per-level item arena, counting the heap
+ * allocations made for each.
+ */
+static void
+benchItems (Suite &suite, unsigned int levels, unsigned int items)
+{
+    unsigned long before = 0;
+    unsigned long after = 0;
+
+    suite.Measure("items/shared_ptr", [&] {
+        std::vector<std::shared_ptr<dungeon::Item>> inventory;
+
+        before = allocations;
+        for (unsigned int level = 0; level < levels; level++) {
+            std::vector<std::shared_ptr<dungeon::Item>> placed;
+            placed.reserve(items);
+
+            for (unsigned int i = 0; i < items; i++) {
+                placed.push_back(std::make_shared<dungeon::Item>());
+            }
+
+            inventory.insert(inventory.end(), placed.begin(), placed.end());
+        }
+        inventory.clear();
+        after = allocations;
+    });
+    suite.Counter("items/shared_ptr", "allocations_per_level",
+                  static_cast<double>(after - before) / levels);
+
+    suite.Measure("items/arena", [&] {
+        dungeon::Player player;
+
+        before = allocations;
+        for (unsigned int level = 0; level < levels; level++) {
+            auto arena = std::make_shared<dungeon::ItemArena>(items);
+
+            dungeon::ItemVector placed;
+            placed.reserve(items);
+
+            for (unsigned int i = 0; i < items; i++) {
+                placed.push_back(arena->Create());
+            }
+
+            player.AddItems(placed.begin(), placed.end(), arena);
+        }
+        player = dungeon::Player();
+        after = allocations;
+    });
+    suite.Counter("items/arena", "allocations_per_level",
+                  static_cast<double>(after - before) / levels);
+}
+
+
+/*
+ * benchLevels
+ *
+ * Time moving from one level to the next, once generating each level at the
+ * moment it is needed and once taking it from a queue that generates levels
+ * in the background while the current one is played.
+ */
+static void
+benchLevels (Suite       &suite,
+             unsigned int width,
+             unsigned int height,
+             unsigned int rooms,
+             unsigned int play_ms)
+{
+    std::string size = std::to_string(width) + "x" + std::to_string(height);
+
+    dungeon::GeneratorParams params;
+    params.width = width;
+    params.height = height;
+    params.rooms = rooms;
+
+    unsigned int level = 0;
+    suite.Measure("levels/sync/" + size, [&] {
+        dungeon::Generator generator(params,
+                                     dungeon::DeriveSeed(SEED, level++));
+        generator.Run();
+    });
+
+    if (!suite.Wants("levels/queued/" + size)) {
+        return;
+    }
+
+    dungeon::LevelQueue queue(params, SEED);
+    auto                current = queue.Next().get();
+
+    for (unsigned int rep = 0; rep < suite.Reps(); rep++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(play_ms));
+
+        auto start = std::chrono::steady_clock::now();
+        current = queue.Next().get();
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        suite.Record("levels/queued/" + size, elapsed.count());
+    }
+    suite.Counter("levels/queued/" + size, "play_ms", play_ms);
+}
+
+
+/*
+ * benchSlices
+ *
+ * Generate a level a stage at a time and then in time-budgeted slices,
+ * recording how long the generator held on to the calling thread in each
+ * call. A sight radius also has the visibility sets built.
+ */
+static void
+benchSlices (Suite       &suite,
+             unsigned int width,
+             unsigned int height,
+             unsigned int rooms,
+             unsigned int budget_ms,
+             unsigned int sight_radius = 0)
+{
+    std::string size = std::to_string(width) + "x" + std::to_string(height);
+    if (sight_radius != 0) {
+        size += "/sight" + std::to_string(sight_radius);
+    }
+
+    dungeon::GeneratorParams params;
+    params.width = width;
+    params.height = height;
+    params.rooms = rooms;
+    params.visibilityRadius = sight_radius;
+
+    for (int sliced = 0; sliced <= 1; sliced++) {
+        std::string name = std::string("slices/") +
+                           (sliced ? "budgeted/" : "stages/") + size;
+        if (!suite.Wants(name)) {
+            continue;
+        }
+
+        std::chrono::milliseconds slice(budget_ms);
+        dungeon::GeneratorBudget  budget(slice);
+        dungeon::Generator        generator(params, SEED);
+
+        while (!generator.IsFinished()) {
+            auto start = std::chrono::steady_clock::now();
+            if (sliced) {
+                generator.Iterate(budget);
+            } else {
+                generator.Iterate();
+            }
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+
+            suite.Record(name, elapsed.count());
+        }
+
+        if (sliced) {
+            suite.Counter(name, "budget_ms", budget_ms);
+        }
+    }
+}
+
+
+static void
+usage (const char *name)
+{
+    std::cerr << "Usage: " << name << " [options]\n"
+        << "  --reps N         Repetitions per benchmark (default 5)\n"
+        << "  --max-time S     Stop repeating a benchmark after S seconds\n"
+        << "                   (default 5)\n"
+        << "  --max-points N   Largest point set for the graph benchmarks\n"
+        << "                   (default 100000)\n"
+        << "  --filter TEXT    Only run benchmarks whose name contains TEXT\n"
+        << "  --json FILE      Also write the results to FILE as JSON, or to\n"
+        << "                   stdout if FILE is -\n";
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    unsigned int reps = 5;
+    double       max_time = 5.0;
+    unsigned int max_points = 100000;
+    const char  *filter = NULL;
+    const char  *json_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        if (std::strcmp(argv[i], "--reps") == 0) {
+            reps = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--max-time") == 0) {
+            max_time = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--max-points") == 0) {
+            max_points = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--filter") == 0) {
+            filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--json") == 0) {
+            json_path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    Suite suite(reps, max_time, filter);
+
+    benchGraph(suite, max_points);
+    benchVisibility(suite);
+    benchObservers(suite, 5000);
+    benchGenerator(suite, dungeon::Map::DEFAULT_WIDTH,
+                   dungeon::Map::DEFAULT_HEIGHT, 20);
+    benchGenerator(suite, 1024, 1024, 100);
+
+    const unsigned int sizes[][3] = {
+        // Width, height, paths
+        { 160, 120, 2000 },
+        { 2048, 2048, 100 },
+    };
+    for (auto &&size : sizes) {
+        benchRouter(suite, "astar", dungeon::PathFinder::A_STAR,
+                    size[0], size[1], size[2]);
+        benchRouter(suite, "jps", dungeon::PathFinder::JUMP_POINT,
+                    size[0], size[1], size[2]);
+    }
+
+    // Roughly the number of items placed on a default sized level.
+    benchItems(suite, 10000, 20);
+
+    benchLevels(suite, 1024, 1024, 100, 250);
+    benchSlices(suite, 2048, 2048, 400, 10);
+    benchSlices(suite, dungeon::Map::DEFAULT_WIDTH, dungeon::Map::DEFAULT_HEIGHT,
+                20, 10, 16);
+
+    suite.Report(std::cout);
+
+    if (json_path != NULL) {
+        if (std::strcmp(json_path, "-") == 0) {
+            suite.WriteJson(std::cout);
+        } else {
+            std::ofstream json(json_path);
+            suite.WriteJson(json);
+            if (!json) {
+                std::cerr << "Failed to write " << json_path << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    return suite.Failed() ? 1 : 0;
+}
@@ -2,9 +2,13 @@
 #include <SDL2/SDL_ttf.h>
 #include <GL/gl.h>
 #include <GL/glu.h>
+#include <iostream>
 #include <memory>
+#include <random>
+#include <stdexcept>
 
 #include "graph.hpp"
+#include "game.hpp"
 #include "gamestate.hpp"
 #include "mainmenu.hpp"
 #include "settings.hpp"
@@ -44,6 +48,22 @@ main (int argc, char *argv[])
     // Set up the gamestate manager and push the initial gamestate.
     gameState.Push(std::make_shared<dungeon::MainMenu>(gameState));
 
+    // A level file given on the command line is played straight away,
+    // returning to the main menu afterwards. The levels below it are
+    // generated. A level that can't be loaded leaves just the main menu.
+    if (argc > 1) {
+        try {
+            auto level = dungeon::Map::Load(argv[1]);
+            gameState.Push(std::make_shared<dungeon::Game>(
+                                nullptr, gameState, level,
+                                std::make_shared<dungeon::LevelQueue>(
+                                    dungeon::Game::LevelParams(),
+                                    std::random_device{}())));
+        } catch (const std::runtime_error &err) {
+            std::cerr << err.what() << std::endl;
+        }
+    }
+
     run = true;
     while (run) {
         // Check for exit event - just peek the event queue as gamestates will
@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "generator.hpp"
+#include "threadpool.hpp"
+
+
+static void
+usage (const char *name)
+{
+    std::cerr << "Usage: " << name << " [options]\n"
+        << "  --seed N         Master seed for the batch (default 0)\n"
+        << "  --count N        Number of maps to generate (default 100)\n"
+        << "  --width N        Map width in tiles (default 160)\n"
+        << "  --height N       Map height in tiles (default 120)\n"
+        << "  --rooms N        Rooms to create per map (default 20)\n"
+        << "  --iters N        Room separation iterations (default 20)\n"
+        << "  --room-min N     Minimum room size (default 8)\n"
+        << "  --room-max N     Maximum room size (default 32)\n"
+        << "  --router NAME    Corridor router, astar or jps (default astar)\n"
+        << "  --graph NAME     Rooms to connect: urquhart, gabriel, rng or mst\n"
+        << "                   (default urquhart)\n"
+        << "  --extra N        Connections to add to an mst (default 0)\n"
+        << "  --visibility N   Build visibility sets of sight radius N\n"
+        << "                   (default 0, none)\n"
+        << "  --threads N      Worker threads, 0 for one per core (default 0)\n"
+        << "  --scaling        Time the batch at 1, 2, 4, ... threads\n"
+        << "  --path-threads N Generate maps one at a time, routing each map's\n"
+        << "                   corridors and building its visibility sets\n"
+        << "                   across N threads\n"
+        << "  --verbose        Log generator progress to stdout (forces a\n"
+        << "                   single-threaded run; room fitting is only\n"
+        << "                   logged by debug builds)\n"
+        << "  --save FILE      Save the batch's first map as a level file\n"
+        << "  --load FILE      Time loading a level file, then exit\n";
+}
+
+
+static bool
+parseUnsigned (const char *str, unsigned int *value)
+{
+    char *end;
+    unsigned long result = std::strtoul(str, &end, 10);
+
+    if (*str == '\0' || *end != '\0') {
+        return false;
+    }
+
+    *value = static_cast<unsigned int>(result);
+    return true;
+}
+
+
+/*
+ * checksumMap
+ *
+ * FNV-1a hash of everything the generator decides about a map, used to check
+ * that batches produce the same maps regardless of thread count.
+ */
+static std::uint64_t
+checksumMap (const dungeon::Map &map)
+{
+    std::uint64_t hash = 14695981039346656037ULL;
+
+    auto mix = [&hash](std::uint64_t value) {
+        hash ^= value;
+        hash *= 1099511628211ULL;
+    };
+
+    for (std::size_t i = 0; i < map.TileCount(); i++) {
+        mix(static_cast<std::uint64_t>(map.GetType(i)));
+        mix(map.IsSpawn(i) ? 1 : 0);
+        mix(map.GetItems(i).size());
+    }
+
+    return hash;
+}
+
+
+/*
+ * runBatch
+ *
+ * Generate a batch of maps on a pool with the given number of threads,
+ * returning the elapsed time in seconds and a checksum over the whole batch.
+ */
+static double
+runBatch (const dungeon::GeneratorParams &params,
+          unsigned int                    seed,
+          unsigned int                    count,
+          unsigned int                    threads,
+          const char                     *save_path,
+          std::uint64_t                  *checksum)
+{
+    util::ThreadPool           pool(threads);
+    std::vector<std::uint64_t> sums(count);
+
+    auto start = std::chrono::steady_clock::now();
+
+    dungeon::GenerateMaps(params, seed, count, pool,
+        [&sums, save_path](unsigned int i, std::shared_ptr<dungeon::Map> map) {
+            sums[i] = checksumMap(*map);
+            if (i == 0 && save_path != NULL) {
+                map->Save(save_path);
+            }
+        });
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    *checksum = 0;
+    for (auto sum : sums) {
+        *checksum = *checksum * 31 + sum;
+    }
+
+    return elapsed.count();
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    dungeon::GeneratorParams params;
+    unsigned int             seed = 0;
+    unsigned int             count = 100;
+    unsigned int             threads = 0;
+    unsigned int             path_threads = 0;
+    bool                     scaling = false;
+    const char              *save_path = NULL;
+    const char              *load_path = NULL;
+
+    params.log = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        unsigned int *value = NULL;
+
+        if (std::strcmp(argv[i], "--seed") == 0) {
+            value = &seed;
+        } else if (std::strcmp(argv[i], "--count") == 0) {
+            value = &count;
+        } else if (std::strcmp(argv[i], "--width") == 0) {
+            value = &params.width;
+        } else if (std::strcmp(argv[i], "--height") == 0) {
+            value = &params.height;
+        } else if (std::strcmp(argv[i], "--rooms") == 0) {
+            value = &params.rooms;
+        } else if (std::strcmp(argv[i], "--iters") == 0) {
+            value = &params.separationIters;
+        } else if (std::strcmp(argv[i], "--room-min") == 0) {
+            value = &params.roomSizeMin;
+        } else if (std::strcmp(argv[i], "--room-max") == 0) {
+            value = &params.roomSizeMax;
+        } else if (std::strcmp(argv[i], "--router") == 0) {
+            if (++i >= argc) {
+                usage(argv[0]);
+                return 1;
+            } else if (std::strcmp(argv[i], "astar") == 0) {
+                params.router = dungeon::PathFinder::A_STAR;
+            } else if (std::strcmp(argv[i], "jps") == 0) {
+                params.router = dungeon::PathFinder::JUMP_POINT;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            continue;
+        } else if (std::strcmp(argv[i], "--graph") == 0) {
+            if (++i >= argc) {
+                usage(argv[0]);
+                return 1;
+            } else if (std::strcmp(argv[i], "urquhart") == 0) {
+                params.connections = graph::URQUHART;
+            } else if (std::strcmp(argv[i], "gabriel") == 0) {
+                params.connections = graph::GABRIEL;
+            } else if (std::strcmp(argv[i], "rng") == 0) {
+                params.connections = graph::RELATIVE_NEIGHBOURHOOD;
+            } else if (std::strcmp(argv[i], "mst") == 0) {
+                params.connections = graph::SPANNING_TREE;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            continue;
+        } else if (std::strcmp(argv[i], "--extra") == 0) {
+            value = &params.extraConnections;
+        } else if (std::strcmp(argv[i], "--save") == 0) {
+            if (++i >= argc) {
+                usage(argv[0]);
+                return 1;
+            }
+            save_path = argv[i];
+            continue;
+        } else if (std::strcmp(argv[i], "--load") == 0) {
+            if (++i >= argc) {
+                usage(argv[0]);
+                return 1;
+            }
+            load_path = argv[i];
+            continue;
+        } else if (std::strcmp(argv[i], "--visibility") == 0) {
+            value = &params.visibilityRadius;
+        } else if (std::strcmp(argv[i], "--threads") == 0) {
+            value = &threads;
+        } else if (std::strcmp(argv[i], "--path-threads") == 0) {
+            value = &path_threads;
+        } else if (std::strcmp(argv[i], "--scaling") == 0) {
+            scaling = true;
+            continue;
+        } else if (std::strcmp(argv[i], "--verbose") == 0) {
+            params.log = &util::Logger::Default();
+            continue;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+
+        if (++i >= argc || !parseUnsigned(argv[i], value)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (load_path != NULL) {
+        try {
+            auto start = std::chrono::steady_clock::now();
+            auto map = dungeon::Map::Load(load_path);
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+
+            std::cout << "Loaded " << map->Width() << "x" << map->Height()
+                << " level in " << elapsed.count() * 1000.0
+                << "ms, checksum " << std::hex << checksumMap(*map)
+                << std::dec << std::endl;
+        } catch (const std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (params.width < 3 || params.height < 3) {
+        std::cerr << "Maps must be at least 3x3 tiles" << std::endl;
+        return 1;
+    }
+
+    if (params.visibilityRadius > dungeon::Map::MAX_VISIBILITY_RADIUS) {
+        std::cerr << "Visibility sets can have a radius of at most "
+            << dungeon::Map::MAX_VISIBILITY_RADIUS << std::endl;
+        return 1;
+    }
+
+    if (params.roomSizeMin > params.roomSizeMax) {
+        std::cerr << "Minimum room size must not exceed the maximum"
+            << std::endl;
+        return 1;
+    }
+
+    if (params.log != NULL || path_threads != 0) {
+        // Logging from several generators at once would interleave, and
+        // parallel corridor routing needs the pool to itself, so generate the
+        // maps one at a time on this thread.
+        std::unique_ptr<util::ThreadPool> path_pool;
+        if (path_threads != 0) {
+            path_pool.reset(new util::ThreadPool(path_threads));
+            params.pathPool = path_pool.get();
+            params.visibilityPool = path_pool.get();
+        }
+
+        std::uint64_t checksum = 0;
+        auto          start = std::chrono::steady_clock::now();
+
+        for (unsigned int i = 0; i < count; i++) {
+            dungeon::Generator generator(params, dungeon::DeriveSeed(seed, i));
+            generator.Run();
+            checksum = checksum * 31 + checksumMap(*generator.GetMap());
+            if (i == 0 && save_path != NULL) {
+                generator.GetMap()->Save(save_path);
+            }
+        }
+
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        if (params.log != NULL) {
+            params.log->Flush();
+        }
+
+        std::cout << "Generated " << count << " maps in " << elapsed.count()
+            << "s, checksum " << std::hex << checksum << std::dec
+            << std::endl;
+        return 0;
+    }
+
+    if (!scaling) {
+        std::uint64_t checksum;
+        double        elapsed = runBatch(params, seed, count, threads,
+                                         save_path, &checksum);
+
+        std::cout << "Generated " << count << " maps in " << elapsed
+            << "s (" << (elapsed > 0 ? count / elapsed : 0)
+            << " maps/s), checksum " << std::hex << checksum << std::dec
+            << std::endl;
+        return 0;
+    }
+
+    // Run the same batch at increasing thread counts, up to the requested
+    // count (or the number of hardware threads).
+    unsigned int  max_threads =
+        threads != 0 ? threads : util::ThreadPool().Size();
+    double        base_elapsed = 0;
+    std::uint64_t base_checksum = 0;
+
+    for (unsigned int t = 1; ; t = std::min(t * 2, max_threads)) {
+        std::uint64_t checksum;
+        double        elapsed = runBatch(params, seed, count, t, NULL,
+                                         &checksum);
+
+        if (t == 1) {
+            base_elapsed = elapsed;
+            base_checksum = checksum;
+        }
+
+        std::cout << t << " threads: " << (elapsed > 0 ? count / elapsed : 0)
+            << " maps/s, speedup " << (elapsed > 0 ? base_elapsed / elapsed : 0)
+            << "x, checksum " << std::hex << checksum << std::dec
+            << (checksum == base_checksum ? "" : " MISMATCH") << std::endl;
+
+        if (checksum != base_checksum) {
+            return 1;
+        }
+
+        if (t == max_threads) {
+            break;
+        }
+    }
+
+    return 0;
+}
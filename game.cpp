@@ -1,5 +1,6 @@
 #include <SDL2/SDL.h>
 #include <GL/gl.h>
+#include <algorithm>
 #include "game.hpp"
 #include "map.hpp"
 #include "pausemenu.hpp"
@@ -9,33 +10,17 @@ namespace dungeon
 {
     void Game::UpdateVisibility()
     {
-        const int SIGHT_DISTANCE = 256;
-
-        // TODO: Make this more efficient - probably move into map and just
-        // look at the nearby tiles.
-        m_map->ResetVisibility();
-        for (auto tileIter = m_map->beginTiles();
-             tileIter != m_map->endTiles();
-             ++tileIter) {
-            int x_dist = static_cast<int>(m_player.x) - static_cast<int>(tileIter->x);
-            int y_dist = static_cast<int>(m_player.y) - static_cast<int>(tileIter->y);
-            if (x_dist * x_dist + y_dist * y_dist <= SIGHT_DISTANCE) {
-                if (m_map->IsVisible(m_player.x, m_player.y,
-                                     tileIter->x, tileIter->y)) {
-                    tileIter->visible = true;
-                    tileIter->seen = true;
-                }
-            }
-        }
+        m_map->UpdateVisibility(m_player.x, m_player.y, SIGHT_RADIUS);
     }
 
 
     void Game::PickupItems()
     {
-        auto &tile = m_map->GetTile(m_player.x, m_player.y);
-        if (!tile.items.empty()) {
-            m_player.AddItems(tile.items.begin(), tile.items.end());
-            tile.items.clear();
+        std::size_t index = m_map->TileIndex(m_player.x, m_player.y);
+        if (m_map->HasItems(index)) {
+            ItemVector items = m_map->TakeItems(index);
+            m_player.AddItems(items.begin(), items.end(),
+                              m_map->GetItemArena());
         }
     }
 
@@ -43,20 +28,29 @@ namespace dungeon
     void Game::Start()
     {
         // Find a spawn point.
-        for (auto tileIter = m_map->beginTiles();
-             tileIter != m_map->endTiles();
-             ++tileIter) {
-            if (tileIter->spawn) {
-                m_player.x = tileIter->x;
-                m_player.y = tileIter->y;
-                break;
-            }
+        m_map->FindSpawn(&m_player.x, &m_player.y);
+
+        // Claim the level after this one, which the queue is most likely
+        // generating already.
+        if (m_levels && !m_nextLevel.valid()) {
+            m_nextLevel = m_levels->Next();
         }
 
         UpdateVisibility();
     }
 
 
+    void Game::NextLevel()
+    {
+        if (!m_nextLevel.valid()) {
+            return;
+        }
+
+        m_map = m_nextLevel.get();
+        Start();
+    }
+
+
     void Game::Run()
     {
         SDL_Event e;
@@ -85,18 +79,23 @@ namespace dungeon
         }
 
         if ((newX != static_cast<int>(m_player.x) || newY != static_cast<int>(m_player.y)) &&
-            newX > 0 && newX < static_cast<int>(Map::MAP_WIDTH - 1) &&
-            newY > 0 && newY < static_cast<int>(Map::MAP_HEIGHT - 1)) {
-            Tile &tile = m_map->GetTile(newX, newY);
+            newX > 0 && newX < static_cast<int>(m_map->Width() - 1) &&
+            newY > 0 && newY < static_cast<int>(m_map->Height() - 1)) {
+            auto tile = m_map->GetTile(newX, newY);
 
-            if (tile.type == Tile::FLOOR ||
-                tile.type == Tile::DOOR_OPEN) {
+            if (tile.Type() == Tile::FLOOR ||
+                tile.Type() == Tile::DOOR_OPEN) {
                 m_player.x = newX;
                 m_player.y = newY;
                 UpdateVisibility();
                 PickupItems();
-            } else if (tile.type == Tile::DOOR_CLOSED) {
-                tile.type = Tile::DOOR_OPEN;
+            } else if (tile.Type() == Tile::STAIRS) {
+                m_player.x = newX;
+                m_player.y = newY;
+                NextLevel();
+            } else if (tile.Type() == Tile::DOOR_CLOSED) {
+                tile.SetType(Tile::DOOR_OPEN);
+                m_map->InvalidateVisibility(tile.Index());
                 UpdateVisibility();
             }
         }
@@ -110,27 +109,34 @@ namespace dungeon
         const unsigned int MINIMAP_WIDTH = 200;
         const unsigned int MINIMAP_HEIGHT = 200;
 
-        // Work out the size of a tile.
-        const unsigned int tile_width = MINIMAP_WIDTH / m_map->Width();
-        const unsigned int tile_height = MINIMAP_HEIGHT / m_map->Width();
-
-        for (auto tileIter = m_map->cbeginTiles();
-             tileIter != m_map->endTiles();
-             ++tileIter) {
-
-            if (!tileIter->IsEmpty() && tileIter->seen) {
-                unsigned int x = tileIter->x * tile_width + MINIMAP_START_X;
-                unsigned int y = tileIter->y * tile_height + MINIMAP_START_Y;
-                if (tileIter->x == m_player.x && tileIter->y == m_player.y) {
-                    glColor4f(1, 0, 0, 1);
-                } else {
-                    glColor4f(1, 1, 1, 1);
-                }
-                glRecti(x, y, x + tile_width, y + tile_height);
-
-                if (!tileIter->visible) {
-                    glColor4f(0, 0, 0, 0.3f);
+        // Draw a cell per tile, or if the map is bigger than the minimap,
+        // a cell per block of tiles showing the block's top-left tile.
+        const unsigned int columns = std::min(m_map->Width(), MINIMAP_WIDTH);
+        const unsigned int rows = std::min(m_map->Height(), MINIMAP_HEIGHT);
+        const unsigned int tile_width = MINIMAP_WIDTH / columns;
+        const unsigned int tile_height = MINIMAP_HEIGHT / rows;
+        const unsigned int player_column = m_player.x * columns / m_map->Width();
+        const unsigned int player_row = m_player.y * rows / m_map->Height();
+
+        for (unsigned int row = 0; row < rows; row++) {
+            for (unsigned int column = 0; column < columns; column++) {
+                auto tile = m_map->GetTile(column * m_map->Width() / columns,
+                                           row * m_map->Height() / rows);
+
+                if (!tile.IsEmpty() && tile.IsSeen()) {
+                    unsigned int x = column * tile_width + MINIMAP_START_X;
+                    unsigned int y = row * tile_height + MINIMAP_START_Y;
+                    if (column == player_column && row == player_row) {
+                        glColor4f(1, 0, 0, 1);
+                    } else {
+                        glColor4f(1, 1, 1, 1);
+                    }
                     glRecti(x, y, x + tile_width, y + tile_height);
+
+                    if (!tile.IsVisible()) {
+                        glColor4f(0, 0, 0, 0.3f);
+                        glRecti(x, y, x + tile_width, y + tile_height);
+                    }
                 }
             }
         }
@@ -149,43 +155,48 @@ namespace dungeon
         unsigned int start_y = (TILE_COUNT_Y - 1) / 2 > m_player.y ?
             0 : m_player.y - (TILE_COUNT_Y - 1) / 2;
 
-        if (start_x + TILE_COUNT_X >= Map::MAP_WIDTH) {
-            start_x = Map::MAP_WIDTH - TILE_COUNT_X - 1;
+        if (m_map->Width() <= TILE_COUNT_X) {
+            start_x = 0;
+        } else if (start_x + TILE_COUNT_X >= m_map->Width()) {
+            start_x = m_map->Width() - TILE_COUNT_X - 1;
         }
 
-        if (start_y + TILE_COUNT_Y >= Map::MAP_HEIGHT) {
-            start_y = Map::MAP_HEIGHT - TILE_COUNT_Y - 1;
+        if (m_map->Height() <= TILE_COUNT_Y) {
+            start_y = 0;
+        } else if (start_y + TILE_COUNT_Y >= m_map->Height()) {
+            start_y = m_map->Height() - TILE_COUNT_Y - 1;
         }
 
-        for (auto tileIter = m_map->beginTiles();
-             tileIter != m_map->endTiles();
-             ++tileIter) {
-            if (tileIter->x >= start_x &&
-                tileIter->x < start_x + TILE_COUNT_X &&
-                tileIter->y >= start_y &&
-                tileIter->y < start_y + TILE_COUNT_Y) {
+        unsigned int end_x = std::min(start_x + TILE_COUNT_X, m_map->Width());
+        unsigned int end_y = std::min(start_y + TILE_COUNT_Y, m_map->Height());
+
+        for (unsigned int tile_y = start_y; tile_y < end_y; tile_y++) {
+            for (unsigned int tile_x = start_x; tile_x < end_x; tile_x++) {
+                auto tile = m_map->GetTile(tile_x, tile_y);
 
-                if (!tileIter->IsEmpty() && tileIter->seen) {
-                    if (tileIter->x == m_player.x && tileIter->y == m_player.y) {
+                if (!tile.IsEmpty() && tile.IsSeen()) {
+                    if (tile_x == m_player.x && tile_y == m_player.y) {
                         glColor4f(0.8f, 0.3f, 0.3f, 1.0f);
-                    } else if (tileIter->type == Tile::FLOOR ||
-                               tileIter->type == Tile::DOOR_OPEN) {
-                        if (!tileIter->items.empty()) {
+                    } else if (tile.Type() == Tile::FLOOR ||
+                               tile.Type() == Tile::DOOR_OPEN) {
+                        if (tile.HasItems()) {
                             glColor4f(1, 0, 0, 1);
                         } else {
                             glColor4f(1, 1, 1, 1);
                         }
-                    } else if (tileIter->type == Tile::WALL) {
+                    } else if (tile.Type() == Tile::WALL) {
                         glColor4f(0.3f, 0.3f, 0.8f, 1.0f);
-                    } else if (tileIter->type == Tile::DOOR_CLOSED) {
+                    } else if (tile.Type() == Tile::DOOR_CLOSED) {
                         glColor4f(0, 0.3f, 0, 1);
+                    } else if (tile.Type() == Tile::STAIRS) {
+                        glColor4f(0.9f, 0.8f, 0.2f, 1.0f);
                     }
 
-                    unsigned int x = (tileIter->x - start_x) * TILE_SIZE;
-                    unsigned int y = (tileIter->y - start_y) * TILE_SIZE;
+                    unsigned int x = (tile_x - start_x) * TILE_SIZE;
+                    unsigned int y = (tile_y - start_y) * TILE_SIZE;
                     glRecti(x, y, x + TILE_SIZE, y + TILE_SIZE);
                     
-                    if (!tileIter->visible) {
+                    if (!tile.IsVisible()) {
                         glColor4f(0, 0, 0, 0.3f);
                         glRecti(x, y, x + TILE_SIZE, y + TILE_SIZE);
                     }
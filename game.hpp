@@ -3,7 +3,10 @@
 
 #include <SDL2/SDL.h>
 
+#include <future>
+
 #include "gamestate.hpp"
+#include "levelqueue.hpp"
 #include "map.hpp"
 #include "player.hpp"
 
@@ -13,9 +16,24 @@ namespace dungeon
     class Game : public GameState
     {
         public:
+            // How far the player can see.
+            static const unsigned int SIGHT_RADIUS = 16;
+
+            // The parameters to generate levels for the game with, which
+            // build the visibility sets for the player's sight.
+            static GeneratorParams LevelParams()
+            {
+                GeneratorParams params;
+                params.visibilityRadius = SIGHT_RADIUS;
+                return params;
+            }
+
+            // Levels after the first are taken from levels when the player
+            // goes down the stairs. Without a queue, the stairs lead nowhere.
             Game(SDL_Renderer *renderer, GameStateManager &manager,
-                 std::shared_ptr<Map> map)
-                : m_manager(manager), m_map(map)
+                 std::shared_ptr<Map> map,
+                 std::shared_ptr<LevelQueue> levels = nullptr)
+                : m_manager(manager), m_map(map), m_levels(levels)
             {
             }
 
@@ -26,11 +44,14 @@ namespace dungeon
         private:
             void UpdateVisibility();
             void PickupItems();
+            void NextLevel();
             void DrawMiniMap() const;
 
-            GameStateManager     &m_manager;
-            std::shared_ptr<Map>  m_map;
-            Player                m_player;
+            GameStateManager                  &m_manager;
+            std::shared_ptr<Map>               m_map;
+            std::shared_ptr<LevelQueue>        m_levels;
+            std::future<std::shared_ptr<Map>>  m_nextLevel;
+            Player                             m_player;
     };
 }
 
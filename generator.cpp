@@ -1,15 +1,11 @@
-#include <SDL2/SDL.h>
-#include <GL/gl.h>
+#include <atomic>
 #include <cmath>
 #include <random>
-#include <queue>
 #include <iostream>
 #include <algorithm>
 #include <sstream>
-#include <unordered_map>
 
 #include "generator.hpp"
-#include "game.hpp"
 #include "util.hpp"
 
 namespace dungeon
@@ -29,13 +25,15 @@ namespace dungeon
         int adjust_x;
         int adjust_y;
 
-        // Check for intersections with other rooms.
-        // TODO: efficient lookup for collisions with other
-        // rooms, rather than scanning the whole lot - possibly
-        // only worth it for large room numbers.
+        // Check for intersections with other rooms, only looking at the
+        // rooms that the grid says are nearby.
+        unsigned int index =
+            static_cast<unsigned int>(m_currentRoom - m_rooms.begin());
         Room &room = *m_currentRoom;
-        for (auto&& other : m_rooms) {
-            if (&room != &other &&
+        m_roomGrid.Query(room, m_candidates);
+        for (auto id : m_candidates) {
+            Room &other = m_rooms[id];
+            if (id != index &&
                 room.Intersects(other,
                                 &adjust_x,
                                 &adjust_y)) {
@@ -48,9 +46,10 @@ namespace dungeon
                     total_adjust_y += adjust_y;
                 }
 
-                std::cout << room << " intersects with "
-                    << other << ", adjust (" << adjust_x
-                    << ", " << adjust_y << ")" << std::endl;
+                UTIL_LOG(m_params.log, util::LOG_DEBUG,
+                         room << " intersects with " << other
+                         << ", adjust (" << adjust_x << ", " << adjust_y
+                         << ")");
             }
 
         }
@@ -60,10 +59,9 @@ namespace dungeon
             intersect_count++;
             total_adjust_x += adjust_x;
             total_adjust_y += adjust_y;
-            std::cout
-                << room << " intersects with walls, adjust ("
-                << adjust_x << ", " << adjust_y << ")"
-                << std::endl;
+            UTIL_LOG(m_params.log, util::LOG_DEBUG,
+                     room << " intersects with walls, adjust ("
+                     << adjust_x << ", " << adjust_y << ")");
         }
 
         if (intersect_count > 0) {
@@ -76,24 +74,44 @@ namespace dungeon
                 util::symmetric_ceil(
                     (static_cast<float>(total_adjust_y) /
                      static_cast<float>(intersect_count)) * 1.2f);
-            std::cout << "Found " << intersect_count
-                << " intersections for " << room
-                << " moving (" << final_adjust_x << ", "
-                << final_adjust_y << ")" << std::endl;
+            UTIL_LOG(m_params.log, util::LOG_DEBUG,
+                     "Found " << intersect_count << " intersections for "
+                     << room << " moving (" << final_adjust_x << ", "
+                     << final_adjust_y << ")");
             m_lastMove.first = room;
-            room.Move(final_adjust_x, final_adjust_y);
+            MoveRoom(index, final_adjust_x, final_adjust_y);
             m_lastMove.second = room;
         }
     }
 
 
-    int Generator::PathHeuristic (Tile *tile, Tile *goal)
+    void Generator::MoveRoom(unsigned int index, int x, int y)
     {
-        int x_diff = static_cast<int>(tile->x) -
-                                        static_cast<int>(goal->x);
-        int y_diff = static_cast<int>(tile->y) -
-                                        static_cast<int>(goal->y);
-        return x_diff * x_diff + y_diff * y_diff;
+        Room &room = m_rooms[index];
+        Room old = room;
+
+        room.Move(x, y);
+        m_roomGrid.Move(index, old, room);
+
+        RasterizeRoom(old, -1);
+        RasterizeRoom(room, 1);
+    }
+
+
+    void Generator::IndexRooms()
+    {
+        // Cover the map plus a room-sized border, as rooms start out
+        // overlapping the edges. Rooms further out than that are still found,
+        // as they are filed in the edge cells.
+        int border = static_cast<int>(m_params.roomSizeMax);
+        m_roomGrid.Reset(-border, -border,
+                         m_map->Width() + 2 * m_params.roomSizeMax,
+                         m_map->Height() + 2 * m_params.roomSizeMax,
+                         m_params.roomSizeMax);
+
+        for (unsigned int i = 0; i < m_rooms.size(); i++) {
+            m_roomGrid.Insert(i, m_rooms[i]);
+        }
     }
 
 
@@ -114,11 +132,11 @@ namespace dungeon
             if (adjust_x != NULL) {
                 *adjust_x = -room.Left();
             }
-        } else if (room.Right() > static_cast<int>(MAP_WIDTH) - 1) {
+        } else if (room.Right() > static_cast<int>(m_map->Width()) - 1) {
             out = true;
             if (adjust_x != NULL) {
                 *adjust_x =
-                    static_cast<int>(MAP_WIDTH) - room.Right() - 1;
+                    static_cast<int>(m_map->Width()) - room.Right() - 1;
             }
         }
 
@@ -127,12 +145,12 @@ namespace dungeon
             if (adjust_y != NULL) {
                 *adjust_y = -room.Top();
             }
-        } else if (room.Bottom() > static_cast<int>(MAP_HEIGHT) - 1) {
+        } else if (room.Bottom() > static_cast<int>(m_map->Height()) - 1) {
             out = true;
 
             if (adjust_y != NULL) {
                 *adjust_y =
-                    static_cast<int>(MAP_HEIGHT) - room.Bottom() - 1;
+                    static_cast<int>(m_map->Height()) - room.Bottom() - 1;
             }
         }
 
@@ -140,77 +158,124 @@ namespace dungeon
     }
 
 
-    void Generator::CreatePaths()
+    void Generator::RoutePath(PathFinder &finder, std::size_t edge)
     {
-        // Use A* to plot paths between the rooms.
-        for (auto &&edge : m_urquhartEdges) {
-            Tile *start = &m_map->GetTile(
-                                    static_cast<int>(edge.p1.x),
-                                    static_cast<int>(edge.p1.y));
-            Tile *end = &m_map->GetTile(
-                                    static_cast<int>(edge.p2.x),
-                                    static_cast<int>(edge.p2.y));
-
-            std::unordered_map<Tile *, int> cost_so_far;
-            std::unordered_map<Tile *, Tile *> came_from;
-            std::priority_queue<
-                std::pair<int, Tile *>,
-                std::vector<std::pair<int, Tile *>>,
-                std::greater<std::pair<int, Tile *>>> open;
-            std::vector<Tile *> closed;
-
-            came_from[start] = start;
-            cost_so_far[start] = 0;
-            open.emplace(0, start);
-
-            while (!open.empty()) {
-                auto current = open.top().second;
-                open.pop();
-
-                if (current == end) {
+        auto RoomToTile = [this](std::uint32_t room) {
+            return static_cast<std::uint32_t>(
+                m_map->TileIndex(m_rooms[room].CenterX(),
+                                 m_rooms[room].CenterY()));
+        };
+
+        finder.FindPath(RoomToTile(m_roomEdges[edge].a),
+                        RoomToTile(m_roomEdges[edge].b),
+                        m_edgePaths[edge]);
+    }
+
+
+    void Generator::StartPaths()
+    {
+        // Give each thread routing paths its own workspace.
+        std::size_t workers =
+            m_params.pathPool != NULL ? m_params.pathPool->Size() : 1;
+        m_pathFinders.resize(workers);
+        for (auto &&finder : m_pathFinders) {
+            finder.Resize(m_map->Width(), m_map->Height());
+            finder.ResetStats();
+            finder.SetMethod(m_params.router);
+        }
+        m_edgePaths.clear();
+        m_edgePaths.resize(m_roomEdges.size());
+    }
+
+
+    void Generator::RoutePaths(const GeneratorBudget                *budget,
+                               std::chrono::steady_clock::time_point start)
+    {
+        // Plot paths between the rooms. The searches never look at the map -
+        // every tile can be crossed - so they are independent of each other
+        // and can run in parallel, each thread taking the next edge as it
+        // finishes one. Without a budget every path is routed in one go;
+        // with a time limit, until it runs out; with only a step limit, a
+        // path per thread.
+        std::size_t workers = m_pathFinders.size();
+        std::size_t end = m_roomEdges.size();
+        bool        timed = budget != NULL &&
+                            budget->time !=
+                                std::chrono::steady_clock::duration::zero();
+
+        if (budget != NULL && !timed) {
+            end = std::min(m_progress + workers, end);
+        }
+
+        // An edge is only taken to be routed, so every edge before the
+        // counter is done once the loop is over.
+        std::atomic<std::size_t> next(m_progress);
+        auto route = [&](std::size_t worker) {
+            std::size_t edge;
+            while ((edge = next++) < end) {
+                RoutePath(m_pathFinders[worker], edge);
+                if (timed && std::chrono::steady_clock::now() - start >=
+                                 budget->time) {
                     break;
-                } else {
-                    // Don't consider diagonal neighbours when creating paths
-                    // so that diagonal paths are wider.
-                    for (auto *neighbour : m_map->GetTileNeighbours(current, false)) {
-                        int new_cost = cost_so_far[current] + 1;
-
-                        if (!cost_so_far.count(neighbour) ||
-                                new_cost < cost_so_far[neighbour]) {
-                            cost_so_far[neighbour] = new_cost;
-
-                            open.emplace(PathHeuristic(neighbour, end),
-                                         neighbour);
-                            came_from[neighbour] = current;
-                        }
-                    }
                 }
             }
+        };
+
+        if (workers == 1) {
+            route(0);
+        } else {
+            m_params.pathPool->ParallelFor(workers, route);
+        }
 
-            // Mark the path on the map.
-            auto current = came_from[end];
-            while (current != start) {
-                current->type = Tile::FLOOR;
-                current = came_from[current];
+        m_progress = std::min<std::size_t>(next, end);
+    }
+
+
+    void Generator::FinishPaths()
+    {
+        // Mark the paths on the map, in edge order so that the result is the
+        // same however the searches were scheduled.
+        PathFinder::Stats stats;
+        for (auto &&path : m_edgePaths) {
+            for (auto tile : path) {
+                m_map->SetType(tile, Tile::FLOOR);
             }
         }
+
+        for (auto &&finder : m_pathFinders) {
+            stats.searches += finder.GetStats().searches;
+            stats.expansions += finder.GetStats().expansions;
+            stats.seconds += finder.GetStats().seconds;
+        }
+
+        UTIL_LOG(m_params.log, util::LOG_INFO,
+                 "Routed " << stats.searches << " paths on "
+                 << m_pathFinders.size() << " threads, " << stats.expansions
+                 << " expansions in " << stats.seconds * 1000.0
+                 << "ms of search time");
     }
 
 
-    void Generator::CreateWalls()
+    void Generator::CreateWalls(unsigned int row)
     {
-        for (auto iter = m_map->beginTiles(); iter != m_map->endTiles(); ++iter)  {
-            if (iter->type == Tile::FLOOR) {
-                for (auto *tile : m_map->GetTileNeighbours(iter)) {
-                    if (tile->type == Tile::EMPTY) {
-                        tile->type = Tile::WALL;
+        std::array<std::size_t, 8> neighbours;
+        std::size_t                begin = m_map->TileIndex(0, row);
+        std::size_t                end = begin + m_map->Width();
+
+        for (std::size_t i = begin; i < end; i++) {
+            if (m_map->GetType(i) == Tile::FLOOR) {
+                std::size_t count = m_map->GetTileNeighbours(i, neighbours);
+                for (std::size_t n = 0; n < count; n++) {
+                    if (m_map->GetType(neighbours[n]) == Tile::EMPTY) {
+                        m_map->SetType(neighbours[n], Tile::WALL);
                     }
                 }
 
                 // If the tile is at the edge of the map, make it a wall.
-                if (iter->x == 0 || iter->x == MAP_WIDTH - 1 ||
-                    iter->y == 0 || iter->y == MAP_HEIGHT - 1) {
-                    iter->type = Tile::WALL;
+                unsigned int x = m_map->TileX(i);
+                if (x == 0 || x == m_map->Width() - 1 ||
+                    row == 0 || row == m_map->Height() - 1) {
+                    m_map->SetType(i, Tile::WALL);
                 }
             }
         }
@@ -220,24 +285,21 @@ namespace dungeon
     void Generator::PlacePlayer()
     {
         // Pick a non-empty tile to spawn the player.
+        const std::uint8_t *types = m_map->Types();
         std::uniform_int_distribution<unsigned int> tile_dis(
-            0, std::count_if(
-                    m_map->beginTiles(), m_map->endTiles(),
-                    [](const Tile& tile) { return tile.type == Tile::FLOOR; }));
+            0, std::count(types, types + m_map->TileCount(), Tile::FLOOR));
         unsigned int tileIdx = tile_dis(m_randomGen);
-        for (auto tileIter = m_map->beginTiles();
-             tileIter != m_map->endTiles();
-             ++tileIter) {
-            if (tileIter->type == Tile::FLOOR) {
+        for (std::size_t i = 0; i < m_map->TileCount(); i++) {
+            if (types[i] == Tile::FLOOR) {
                 if (--tileIdx == 0) {
-                    tileIter->spawn = true;
+                    m_map->SetSpawn(i, true);
                 }
             }
         }
     }
 
 
-    void Generator::PlaceDoors()
+    void Generator::PlaceDoors(unsigned int row)
     {
         // Note that here we use EMPTY to mean 'any tile allowed', rather than
         // that the tile has to be empty.
@@ -264,22 +326,22 @@ namespace dungeon
             }
         };
 
-        for (auto tileIter = m_map->beginTiles(); tileIter != m_map->endTiles(); ++tileIter) {
-            if (tileIter->x == 0 || tileIter->y == 0 ||
-                tileIter->x == m_map->Width() - 1 || tileIter->y == m_map->Height() - 1) {
-                // No doors at the edge of the map.
-                continue;
-            }
+        // No doors at the edge of the map.
+        if (row == 0 || row >= m_map->Height() - 1) {
+            return;
+        }
 
-            // Search for the 'door pattern' - a set of tiles suitable for placing
-            // a door.
+        unsigned int tile_y = row;
+        for (unsigned int tile_x = 1; tile_x < m_map->Width() - 1; tile_x++) {
+            // Search for the 'door pattern' - a set of tiles suitable for
+            // placing a door.
             bool matches_pattern = false;
             for (size_t p = 0; !matches_pattern && p < 4; p++) {
                 matches_pattern = true;
                 for (unsigned int x = 0; x <= 2; x++) {
                     for (unsigned int y = 0; y <= 2; y++) {
-                        auto type = m_map->GetTile(tileIter->x + x - 1,
-                                                   tileIter->y + y - 1).type;
+                        auto type = m_map->GetType(tile_x + x - 1,
+                                                   tile_y + y - 1);
                         if (door_patterns[p][y][x] != Tile::EMPTY &&
                             door_patterns[p][y][x] != type) {
                             matches_pattern = false;
@@ -292,178 +354,362 @@ namespace dungeon
                 // TODO: Vary door percentage.
                 std::bernoulli_distribution dist(0.5);
                 if (dist(m_randomGen)) {
-                    tileIter->type = Tile::DOOR_CLOSED;
+                    m_map->SetType(tile_x, tile_y, Tile::DOOR_CLOSED);
                 }
             }
         }
     }
 
 
-    void Generator::PlaceItems()
+    void Generator::PlaceItems(unsigned int row)
     {
         std::bernoulli_distribution dist(0.001);
+        std::size_t                 begin = m_map->TileIndex(0, row);
+        std::size_t                 end = begin + m_map->Width();
         
-        for (auto iter = m_map->beginTiles(); iter != m_map->endTiles(); ++iter) {
+        for (std::size_t i = begin; i < end; i++) {
             if (dist(m_randomGen)) {
-                iter->items.push_back(std::make_shared<Item>());
+                m_itemTiles.push_back(i);
+            }
+        }
+    }
+
+
+    void Generator::CreateItems()
+    {
+        // Knowing the number of items up front lets the arena put them all
+        // in one block.
+        m_map->ReserveItems(m_itemTiles.size());
+        for (auto tile : m_itemTiles) {
+            m_map->CreateItem(tile);
+        }
+    }
+
+
+    void Generator::PlaceStairs()
+    {
+        // Put the stairs down to the next level in the middle of the room
+        // furthest from the player's spawn point.
+        unsigned int spawn_x, spawn_y;
+        if (!m_map->FindSpawn(&spawn_x, &spawn_y)) {
+            return;
+        }
+
+        long         best_distance = -1;
+        unsigned int stairs_x = 0;
+        unsigned int stairs_y = 0;
+        for (auto &&room : m_rooms) {
+            unsigned int x = room.CenterX();
+            unsigned int y = room.CenterY();
+            if (m_map->GetType(x, y) != Tile::FLOOR) {
+                continue;
+            }
+
+            long dx = static_cast<long>(x) - static_cast<long>(spawn_x);
+            long dy = static_cast<long>(y) - static_cast<long>(spawn_y);
+            if (dx * dx + dy * dy > best_distance) {
+                best_distance = dx * dx + dy * dy;
+                stairs_x = x;
+                stairs_y = y;
             }
         }
+
+        if (best_distance >= 0) {
+            m_map->SetType(stairs_x, stairs_y, Tile::STAIRS);
+        }
+    }
+
+
+    void Generator::StartVisibility()
+    {
+        // The level is laid out, so what can be seen from where is fixed
+        // apart from the doors.
+        m_visibilitySets.reset(
+            new VisibilitySetBuilder(*m_map, m_params.visibilityRadius));
+    }
+
+
+    void Generator::BuildVisibility(unsigned int row)
+    {
+        m_visibilitySets->BuildRow(row, m_params.visibilityPool);
     }
 
 
-    void Generator::RoomsToTiles()
+    void Generator::FinishVisibility()
     {
-        // Clear the map.
-        m_map->Clear();
-
-        // Fill in the map squares taken by rooms.
-        for (auto&& room : m_rooms) {
-            for (int x = room.Left(); x < room.Right(); x++) {
-                for (int y = room.Top(); y < room.Bottom(); y++) {
-                    // Ignore squares outside the map - the rooms will all be
-                    // fitted inside the map later.
-                    if (x > 0 && y > 0 &&
-                        x < static_cast<int>(m_map->Width()) &&
-                        y < static_cast<int>(m_map->Height())) {
-                        m_map->GetTile(x, y).type = Tile::FLOOR;
+        UTIL_LOG(m_params.log, util::LOG_INFO,
+                 "Built visibility sets of radius "
+                 << m_params.visibilityRadius << " in "
+                 << m_visibilitySets->Bytes() << " bytes on "
+                 << (m_params.visibilityPool != NULL ?
+                     m_params.visibilityPool->Size() : 1)
+                 << " threads");
+
+        m_visibilitySets->Finish();
+        m_visibilitySets.reset();
+    }
+
+
+    void Generator::RasterizeRoom(const Room &room, int delta)
+    {
+        // Only the room's own rectangle is touched. Tiles keep a count of the
+        // rooms covering them, so that a tile shared by overlapping rooms
+        // stays floor until the last of them has moved away.
+        int left = std::max(room.Left(), 1);
+        int top = std::max(room.Top(), 1);
+        int right = std::min(room.Right(), static_cast<int>(m_map->Width()));
+        int bottom = std::min(room.Bottom(), static_cast<int>(m_map->Height()));
+
+        // Ignore squares outside the map - the rooms will all be fitted
+        // inside the map later.
+        for (int y = top; y < bottom; y++) {
+            for (int x = left; x < right; x++) {
+                auto &coverage =
+                    m_coverage[static_cast<std::size_t>(y) * m_map->Width() + x];
+
+                if (delta > 0) {
+                    if (coverage++ == 0) {
+                        m_map->SetType(x, y, Tile::FLOOR);
                     }
+                } else if (--coverage == 0) {
+                    m_map->SetType(x, y, Tile::EMPTY);
                 }
             }
         }
     }
 
 
-    void Generator::Iterate()
+    void Generator::StartStage()
     {
-        std::cout << "Generator Iteration: Stage " <<
-            Generator::StageToString(m_stage) << std::endl;
-        switch(m_stage) {
-        case CREATE_ROOMS:
-            do {
-                if (m_rooms.size() == MAP_ROOMS) {
-                    // We've created all the rooms we need - move onto the next
-                    // stage
-                    m_currentRoom = m_rooms.begin();
-                    m_foundIntersection = false;
-                    m_collideRooms.clear();
-                    m_stage = FIT_ROOMS;
-                } else {
-                    // Create another room
-                    std::uniform_int_distribution<> x_dis(0, MAP_WIDTH);
-                    std::uniform_int_distribution<> y_dis(0, MAP_HEIGHT);
-                    std::uniform_int_distribution<> size_dis(ROOM_SIZE_MIN,
-                                                             ROOM_SIZE_MAX);
-
-                    Room room(x_dis(m_randomGen),
-                              y_dis(m_randomGen),
-                              size_dis(m_randomGen),
-                              size_dis(m_randomGen));
-                    m_rooms.push_back(room);
-                    RoomsToTiles();
-                }
-            } while (m_stage == CREATE_ROOMS);
-            break;
+        UTIL_LOG(m_params.log, util::LOG_INFO,
+                 "Generator Iteration: Stage "
+                 << Generator::StageToString(m_stage));
+
+        m_progress = 0;
 
+        switch (m_stage) {
         case FIT_ROOMS:
-            do {
-                if (m_currentRoom == m_rooms.end()) {
-                    // Finished the current iteration, see if we need to
-                    // continue
-                    m_fitProgress++;
-                    if (!m_foundIntersection ||
-                        m_fitProgress >= SEPARATION_ITERS) {
-                        m_stage = DISCARD_ROOMS;
-                    } else {
-                        m_foundIntersection = false;
-                        m_currentRoom = m_rooms.begin();
-                        std::cout << "Room separation iteration " << m_fitProgress
-                            << std::endl;
-                    }
-                } else {
-                    // Move to the next room in the current iteration.
-                    m_collideRooms.clear();
-                    FitRoom();
-                    ++m_currentRoom;
-                }
+            m_currentRoom = m_rooms.begin();
+            m_foundIntersection = false;
+            m_collideRooms.clear();
+            IndexRooms();
+            break;
 
-                RoomsToTiles();
-            } while (m_stage == FIT_ROOMS);
+        case CREATE_PATHS:
+            StartPaths();
             break;
 
-        case DISCARD_ROOMS:
-        {
-            // Discard any rooms that are out of bounds or intersecting
-            // other rooms. Remove out-of-bounds rooms first, to ensure
-            // that the minimal number of rooms are removed in the case
-            // where there are rooms that are out-of-bounds and also
-            // intersecting other rooms.
-            m_rooms.erase(std::remove_if(
-                            m_rooms.begin(), m_rooms.end(),
-                            [this](Room r) { return RoomOutOfBounds(r); }),
-                          m_rooms.end());
-
-            auto roomIter = m_rooms.begin();
-            while (roomIter != m_rooms.end()) {
-                bool erased = false;
-                auto &room = *roomIter;
-
-                for (auto&& other : m_rooms) {
-                    if (&room != &other && room.Intersects(other)) {
-                        roomIter = m_rooms.erase(roomIter);
-                        erased = true;
-                    }
-                }
+        case PLACE_ITEMS:
+            m_itemTiles.clear();
+            break;
+
+        case BUILD_VISIBILITY:
+            StartVisibility();
+            break;
+
+        default:
+            break;
+        }
+    }
+
 
-                if (!erased) {
-                    ++roomIter;
+    void Generator::NextStage(GeneratorStage stage)
+    {
+        m_stage = stage;
+        m_stageStarted = false;
+    }
+
+
+    void Generator::DiscardRooms()
+    {
+        // Discard any rooms that are out of bounds or intersecting
+        // other rooms. Remove out-of-bounds rooms first, to ensure
+        // that the minimal number of rooms are removed in the case
+        // where there are rooms that are out-of-bounds and also
+        // intersecting other rooms.
+        m_rooms.erase(std::remove_if(
+                        m_rooms.begin(), m_rooms.end(),
+                        [this](Room r) {
+                            if (RoomOutOfBounds(r)) {
+                                RasterizeRoom(r, -1);
+                                return true;
+                            }
+                            return false;
+                        }),
+                      m_rooms.end());
+
+        // Then discard, in order, each room that intersects a room that
+        // has not already been discarded.
+        IndexRooms();
+        std::vector<bool> discard(m_rooms.size(), false);
+        for (unsigned int i = 0; i < m_rooms.size(); i++) {
+            Room &room = m_rooms[i];
+
+            m_roomGrid.Query(room, m_candidates);
+            for (auto id : m_candidates) {
+                if (id != i && !discard[id] &&
+                    room.Intersects(m_rooms[id])) {
+                    discard[i] = true;
+                    m_roomGrid.Remove(i, room);
+                    break;
                 }
             }
-            RoomsToTiles();
-            m_stage = CONNECT_ROOMS;
+        }
 
-            break;
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < m_rooms.size(); i++) {
+            if (!discard[i]) {
+                m_rooms[kept++] = m_rooms[i];
+            } else {
+                RasterizeRoom(m_rooms[i], -1);
+            }
         }
-        case CONNECT_ROOMS:
-        {
-            using namespace graph;
-            std::vector<Vec2f> centers;
-            for(auto &&room : m_rooms) {
-                centers.push_back(Vec2f(room.CenterX(), room.CenterY()));
+        m_rooms.resize(kept);
+    }
+
+
+    void Generator::ConnectRooms()
+    {
+        using namespace graph;
+        std::vector<Vec2f> centers;
+        for(auto &&room : m_rooms) {
+            centers.push_back(Vec2f(room.CenterX(), room.CenterY()));
+        }
+
+        // Triangulate the room centres once, keeping the triangles to
+        // display and deriving the connections between the rooms from it.
+        Triangulation tri(centers);
+        m_delaunayTris = tri.GetTriangles();
+        m_roomEdges = generateGraph(tri, m_params.connections,
+                                    m_params.extraConnections);
+
+        m_map->SetRooms(m_rooms);
+        m_map->SetRoomEdges(m_roomEdges);
+    }
+
+
+    void Generator::Step(const GeneratorBudget                *budget,
+                         std::chrono::steady_clock::time_point start)
+    {
+        if (m_stage == FINISHED) {
+            return;
+        }
+
+        // Setting up a stage can take a while on a large map, so it is a step
+        // of its own.
+        if (!m_stageStarted) {
+            StartStage();
+            m_stageStarted = true;
+            return;
+        }
+
+        switch(m_stage) {
+        case CREATE_ROOMS:
+            if (m_rooms.size() == m_params.rooms) {
+                // We've created all the rooms we need - move onto the next
+                // stage
+                NextStage(FIT_ROOMS);
+            } else {
+                // Create another room
+                std::uniform_int_distribution<> x_dis(0, m_map->Width());
+                std::uniform_int_distribution<> y_dis(0, m_map->Height());
+                std::uniform_int_distribution<> size_dis(
+                                                m_params.roomSizeMin,
+                                                m_params.roomSizeMax);
+
+                Room room(x_dis(m_randomGen),
+                          y_dis(m_randomGen),
+                          size_dis(m_randomGen),
+                          size_dis(m_randomGen));
+                m_rooms.push_back(room);
+                RasterizeRoom(room, 1);
+            }
+            break;
+
+        case FIT_ROOMS:
+            if (m_currentRoom == m_rooms.end()) {
+                // Finished the current iteration, see if we need to
+                // continue
+                m_fitProgress++;
+                if (!m_foundIntersection ||
+                    m_fitProgress >= m_params.separationIters) {
+                    NextStage(DISCARD_ROOMS);
+                } else {
+                    m_foundIntersection = false;
+                    m_currentRoom = m_rooms.begin();
+                    UTIL_LOG(m_params.log, util::LOG_DEBUG,
+                             "Room separation iteration " << m_fitProgress);
+                }
+            } else {
+                // Move to the next room in the current iteration.
+                m_collideRooms.clear();
+                FitRoom();
+                ++m_currentRoom;
             }
+            break;
 
-            // Generate the delaunay graph just so we can display it, we're
-            // not going to actually use it in the pathfinding.
-            m_delaunayTris = generateDelaunay(centers);
+        case DISCARD_ROOMS:
+            DiscardRooms();
+            NextStage(CONNECT_ROOMS);
+            break;
 
-            // Use an Urquhart graph to determine the connections between
-            // the rooms.
-            m_urquhartEdges = generateUrquhart(centers);
-            m_stage = CREATE_PATHS;
+        case CONNECT_ROOMS:
+            ConnectRooms();
+            NextStage(CREATE_PATHS);
             break;
-        }
+
         case CREATE_PATHS:
-            CreatePaths();
-            m_stage = CREATE_WALLS;
+            if (m_progress < m_roomEdges.size()) {
+                RoutePaths(budget, start);
+            } else {
+                FinishPaths();
+                NextStage(CREATE_WALLS);
+            }
             break;
-            
+
         case CREATE_WALLS:
-            CreateWalls();
-            m_stage = PLACE_PLAYER;
+            if (m_progress < m_map->Height()) {
+                CreateWalls(m_progress++);
+            } else {
+                NextStage(PLACE_PLAYER);
+            }
             break;
 
         case PLACE_PLAYER:
             PlacePlayer();
-            m_stage = PLACE_DOORS;
+            NextStage(PLACE_DOORS);
             break;
 
         case PLACE_DOORS:
-            PlaceDoors();
-            m_stage = PLACE_ITEMS;
+            if (m_progress < m_map->Height()) {
+                PlaceDoors(m_progress++);
+            } else {
+                NextStage(PLACE_ITEMS);
+            }
             break;
-             
+
         case PLACE_ITEMS:
-            PlaceItems();
-            m_stage = FINISHED;
+            if (m_progress < m_map->Height()) {
+                PlaceItems(m_progress++);
+            } else {
+                CreateItems();
+                NextStage(PLACE_STAIRS);
+            }
+            break;
+
+        case PLACE_STAIRS:
+            PlaceStairs();
+            NextStage(m_params.visibilityRadius != 0 ? BUILD_VISIBILITY :
+                                                       FINISHED);
+            break;
+
+        case BUILD_VISIBILITY:
+            if (m_progress < m_map->Height()) {
+                BuildVisibility(m_progress++);
+            } else {
+                FinishVisibility();
+                NextStage(FINISHED);
+            }
             break;
 
         case FINISHED:
@@ -473,104 +719,84 @@ namespace dungeon
     }
 
 
-    void Generator::DrawRoomOutline(const Room &room) const
+    void Generator::Iterate()
     {
-        glBegin(GL_LINE_LOOP);
-            glVertex2i(room.Left() * TILE_WIDTH,
-                       room.Top() * TILE_HEIGHT);
-            glVertex2i(room.Right() * TILE_WIDTH,
-                       room.Top() * TILE_HEIGHT);
-            glVertex2i(room.Right() * TILE_WIDTH,
-                       room.Bottom() * TILE_HEIGHT);
-            glVertex2i(room.Left() * TILE_WIDTH,
-                       room.Bottom() * TILE_HEIGHT);
-        glEnd();
+        GeneratorStage stage = m_stage;
+
+        do {
+            Step();
+        } while (m_stage == stage && m_stage != FINISHED);
     }
 
 
-    void Generator::Draw() const
+    bool Generator::Iterate(const GeneratorBudget &budget)
     {
-        for (auto iter = m_map->beginTiles();
-             iter != m_map->endTiles();
-             ++iter) {
-            const Tile &tile = *iter;
-            if (!tile.IsEmpty()) {
-                if (tile.type == Tile::FLOOR) {
-                    glColor4f(1, 1, 1, 1);
-                } else if (tile.type == Tile::WALL) {
-                    glColor4f(1.0f, 0.5f, 0.5f, 1.0f);
-                } else if (tile.type == Tile::DOOR_CLOSED) {
-                    glColor4f(0.5f, 1.0f, 0.5f, 1.0f);
-                }
+        auto          start = std::chrono::steady_clock::now();
+        unsigned long steps = 0;
+
+        while (m_stage != FINISHED) {
+            Step(&budget, start);
 
-                glRecti(tile.x * TILE_WIDTH,
-                        tile.y * TILE_HEIGHT,
-                        (tile.x + 1) * TILE_WIDTH,
-                        (tile.y + 1) * TILE_HEIGHT);
+            if (budget.steps != 0 && ++steps >= budget.steps) {
+                break;
             }
-        }
 
-        glColor4f(1.0f, 0.0f, 0.0f, 1.0f);
-        for (auto &&tri : m_delaunayTris) {
-            for (auto &&edge : tri.GetEdges()) {
-                glBegin(GL_LINE);
-                    glVertex2i(edge.p1.x * TILE_WIDTH,
-                               edge.p1.y * TILE_HEIGHT);
-                    glVertex2i(edge.p2.x * TILE_WIDTH,
-                               edge.p2.y * TILE_HEIGHT);
-                glEnd();
+            if (budget.time != std::chrono::steady_clock::duration::zero() &&
+                std::chrono::steady_clock::now() - start >= budget.time) {
+                break;
             }
         }
 
-        glColor4f(0.0f, 0.0f, 1.0f, 1.0f);
-        for (auto &&edge : m_urquhartEdges) {
-            glBegin(GL_LINE);
-                glVertex2i(edge.p1.x * TILE_WIDTH,
-                           edge.p1.y * TILE_HEIGHT);
-                glVertex2i(edge.p2.x * TILE_WIDTH,
-                           edge.p2.y * TILE_HEIGHT);
-            glEnd();
-        }
+        return m_stage == FINISHED;
+    }
 
-        if (m_stage == FIT_ROOMS && m_foundIntersection) {
-            glColor4f(0, 0, 1, 0);
-            for (auto &&room : m_collideRooms) {
-                DrawRoomOutline(room);
-            }
 
-            glColor4f(1, 0, 0, 1);
-            DrawRoomOutline(m_lastMove.first);
-            glColor4f(0, 1, 0, 1);
-            DrawRoomOutline(m_lastMove.second);
-
-            int start_x = (m_lastMove.first.Left() + m_lastMove.first.Width() / 2);
-            int start_y = (m_lastMove.first.Top() + m_lastMove.first.Height() / 2);
-            int end_x = (m_lastMove.second.Left() + m_lastMove.second.Width() / 2);
-            int end_y = (m_lastMove.second.Top() + m_lastMove.second.Height() / 2);
-
-            glBegin(GL_LINE);
-            glVertex2i(start_x * TILE_WIDTH,
-                       start_y * TILE_HEIGHT);
-            glVertex2i(end_x * TILE_WIDTH,
-                       end_y * TILE_HEIGHT);
-            glEnd();
-        }
+    unsigned int DeriveSeed(unsigned int seed, unsigned int index)
+    {
+        std::seed_seq seq{seed, index};
+        std::array<unsigned int, 1> result;
+        seq.generate(result.begin(), result.end());
+        return result[0];
     }
 
 
-    void GeneratorGameState::Run()
+    void GenerateMaps(
+            const GeneratorParams                                      &params,
+            unsigned int                                                seed,
+            unsigned int                                                count,
+            util::ThreadPool                                           &pool,
+            const std::function<void(unsigned int, std::shared_ptr<Map>)> &consumer)
     {
-        SDL_Event e;
-
-        if (SDL_PollEvent(&e)) {
-            if (e.type == SDL_KEYDOWN) {
-                m_generator.Iterate();
-                if (m_generator.IsFinished()) {
-                    // Switch to a new game gamestate
-                    m_manager.Replace(std::make_shared<Game>(
-                                m_renderer, m_manager, m_generator.GetMap()));
-                }
-            }
-        }
+        GeneratorParams workerParams = params;
+        workerParams.log = NULL;
+
+        // The maps are already being generated in parallel, and the pool
+        // can't run a loop from inside another one.
+        workerParams.pathPool = NULL;
+        workerParams.visibilityPool = NULL;
+
+        pool.ParallelFor(count, [&](std::size_t i) {
+            unsigned int index = static_cast<unsigned int>(i);
+            Generator generator(workerParams, DeriveSeed(seed, index));
+            generator.Run();
+            consumer(index, generator.GetMap());
+        });
+    }
+
+
+    std::vector<std::shared_ptr<Map>> GenerateMaps(
+            const GeneratorParams &params,
+            unsigned int           seed,
+            unsigned int           count,
+            util::ThreadPool      &pool)
+    {
+        std::vector<std::shared_ptr<Map>> maps(count);
+
+        GenerateMaps(params, seed, count, pool,
+                     [&maps](unsigned int i, std::shared_ptr<Map> map) {
+                         maps[i] = map;
+                     });
+
+        return maps;
     }
 }
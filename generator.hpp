@@ -2,154 +2,158 @@
 #define __GENERATOR_HPP__
 
 
-#include <SDL2/SDL.h>
 #include <array>
+#include <chrono>
 #include <vector>
 #include <random>
 #include <memory>
+#include <functional>
+#include <cstdint>
 
 #include "graph.hpp"
+#include "log.hpp"
 #include "map.hpp"
-#include "gamestate.hpp"
+#include "pathfinder.hpp"
+#include "room.hpp"
+#include "roomgrid.hpp"
+#include "threadpool.hpp"
 
 
 namespace dungeon
 {
-    class Room
+    /*
+     * GeneratorParams
+     *
+     * The tunable parameters for a single generator run.
+     */
+    struct GeneratorParams
     {
-        public:
-            Room()
-            {
-            }
-
-            Room(int          left,
-                 int          top,
-                 unsigned int width,
-                 unsigned int height)
-                : left(left), top(top), width(width), height(height)
-            {
-            }
-
-            bool Intersects (Room &other,
-                             int  *adjust_x = NULL,
-                             int  *adjust_y = NULL)
-            {
-                if (Left() < other.Right() && Right() > other.Left() &&
-                    Top() < other.Bottom() && Bottom() > other.Top()) {
-                    // Intersects, find the intersection distance if required.
-
-                    if (adjust_x != NULL) {
-                        // Work out if moving left or right is shorter.
-                        if (std::abs(Right() - other.Left()) <
-                            std::abs(other.Right() - Left())) {
-                            *adjust_x = other.Left() - Right();
-                        } else {
-                            *adjust_x = other.Right() - Left();
-                        }
-                    }
-                    
-                    if (adjust_y != NULL) {
-                        // Work out if moving up or down is shorter.
-                        if (std::abs(Bottom() - other.Top()) <
-                            std::abs(other.Bottom() - Top())) {
-                            *adjust_y = other.Top() - Bottom();
-                        } else {
-                            *adjust_y = other.Bottom() - Top();
-                        }
-                    }
-
-                    return true;
-                }
-
-                return false;
-            }
+        GeneratorParams()
+            : width(Map::DEFAULT_WIDTH), height(Map::DEFAULT_HEIGHT),
+              rooms(20), separationIters(20), roomSizeMin(8), roomSizeMax(32),
+              router(PathFinder::A_STAR), connections(graph::URQUHART),
+              extraConnections(0), visibilityRadius(0), log(NULL),
+              pathPool(NULL), visibilityPool(NULL)
+        {
+        }
+
+        unsigned int       width;
+        unsigned int       height;
+        unsigned int       rooms;
+        unsigned int       separationIters;
+        unsigned int       roomSizeMin;
+        unsigned int       roomSizeMax;
+
+        // How to route the corridors between rooms.
+        PathFinder::Method router;
+
+        // Which graph of the rooms to build corridors along, and for
+        // graph::SPANNING_TREE, how many connections to add to the tree.
+        graph::GraphType   connections;
+        unsigned int       extraConnections;
+
+        // The sight radius to build the map's visibility sets for, or 0 to
+        // not build them.
+        unsigned int       visibilityRadius;
+
+        // Where to log progress messages, or NULL for none.
+        util::Logger      *log;
+
+        // Pool to route corridors on in parallel, or NULL to route them on
+        // the calling thread.
+        util::ThreadPool  *pathPool;
+
+        // Pool to build the visibility sets on in parallel, or NULL to build
+        // them on the calling thread.
+        util::ThreadPool  *visibilityPool;
+    };
 
-            void Move(int x, int y)
-            {
-                left += x;
-                top += y;
-            }
 
-            int Left() const
-            {
-                return left;
-            }
+    /*
+     * GeneratorBudget
+     *
+     * How much a call to Generator::Iterate may do before returning: a
+     * time limit, a limit on the number of steps, or both. Zero means no
+     * limit. A step is one small piece of a stage, such as creating or
+     * fitting a single room, routing paths (as many as the time limit
+     * allows, or a path per routing thread), or processing a row of tiles.
+     */
+    struct GeneratorBudget
+    {
+        explicit GeneratorBudget(
+                std::chrono::steady_clock::duration time =
+                    std::chrono::steady_clock::duration::zero(),
+                unsigned long steps = 0)
+            : time(time), steps(steps)
+        {
+        }
+
+        std::chrono::steady_clock::duration time;
+        unsigned long                       steps;
+    };
 
-            int Right() const
-            {
-                return left + static_cast<int>(width);
-            }
 
-            int Top() const
+    class Generator
+    {
+        public:
+            Generator()
+                : Generator(GeneratorParams(), std::random_device{}())
             {
-                return top;
             }
 
-            int Bottom() const
+            Generator(const GeneratorParams &params, unsigned int seed)
+                : m_params(params),
+                  m_map(std::make_shared<Map>(params.width, params.height)),
+                  m_coverage(m_map->Width() * m_map->Height(), 0),
+                  m_stage(CREATE_ROOMS),
+                  m_stageStarted(false),
+                  m_progress(0),
+                  m_randomGen(seed),
+                  m_fitProgress(0),
+                  m_lastMove(Room(), Room()),
+                  m_foundIntersection(false)
             {
-                return top + static_cast<int>(height);
             }
 
-            unsigned int Width() const
-            {
-                return width;
-            }
-            
-            unsigned int Height() const
+            std::shared_ptr<Map> GetMap()
             {
-                return height;
+                return m_map;
             }
 
-            int CenterX() const
-            {
-                return static_cast<int>(static_cast<float>(left) +
-                                        static_cast<float>(width) / 2.0f);
+            bool IsFinished() const {
+                return m_stage == FINISHED;
             }
 
-            int CenterY() const
+            // The name of the stage the generator is at.
+            const char * StageName() const
             {
-                return static_cast<int>(static_cast<float>(top) +
-                                        static_cast<float>(height) / 2.0f);
+                return StageToString(m_stage);
             }
 
-        private:
-            int          left;
-            int          top;
-            unsigned int width;
-            unsigned int height;
-    };
-
+            // Run a single stage of the generation.
+            void Iterate();
 
-    class Generator
-    {
-        public:
-            Generator()
-                : m_map(std::make_shared<Map>()),
-                  m_stage(CREATE_ROOMS),
-                  m_randomGen(std::random_device{}()),
-                  m_lastMove(Room(), Room())
-            {
-            };
+            // Run steps of the generation, across as many stages as it
+            // takes, until the budget is spent or the map is finished.
+            // Returns whether the map is finished. This keeps a caller that
+            // has other work to do, such as drawing frames, responsive
+            // however large the map is.
+            bool Iterate(const GeneratorBudget &budget);
 
-            std::shared_ptr<Map> GetMap()
+            // Run all remaining stages, until the map is finished.
+            void Run()
             {
-                return m_map;
-            }
-
-            bool IsFinished() const {
-                return m_stage == FINISHED;
+                while (!IsFinished()) {
+                    Step();
+                }
             }
 
-            void Iterate();
+            // Draw a debug view of the generator's progress. This is
+            // implemented alongside the generator gamestate, so that the
+            // generator itself can be built without GL.
             void Draw() const;
 
         private:
-            static const unsigned int MAP_ROOMS = 20;
-            static const unsigned int SEPARATION_ITERS = 20;
-            static const unsigned int ROOM_SIZE_MIN = 8;
-            static const unsigned int ROOM_SIZE_MAX = 32;
-            static const unsigned int MAP_WIDTH = 160;
-            static const unsigned int MAP_HEIGHT = 120;
             static const unsigned int TILE_WIDTH = 5;
             static const unsigned int TILE_HEIGHT = 5;
 
@@ -163,6 +167,8 @@ namespace dungeon
                 PLACE_PLAYER,
                 PLACE_DOORS,
                 PLACE_ITEMS,
+                PLACE_STAIRS,
+                BUILD_VISIBILITY,
                 FINISHED
             };
 
@@ -187,6 +193,10 @@ namespace dungeon
                     return "Place doors";
                 case PLACE_ITEMS:
                     return "Place items";
+                case PLACE_STAIRS:
+                    return "Place stairs";
+                case BUILD_VISIBILITY:
+                    return "Build visibility";
                 case FINISHED:
                     return "Finished";
                 default:
@@ -194,51 +204,97 @@ namespace dungeon
                 }
             }
 
+            void StartStage();
+            void NextStage(GeneratorStage stage);
+            // Run a step of the generation. Given the budget of the Iterate
+            // call it is part of, and when that started, a step may do more
+            // than its smallest piece of work while the budget lasts.
+            void Step(const GeneratorBudget                    *budget = NULL,
+                      std::chrono::steady_clock::time_point start =
+                          std::chrono::steady_clock::time_point());
+            void IndexRooms();
+            void MoveRoom(unsigned int index, int x, int y);
             void FitRoom();
             void DrawRoomOutline(const Room &room) const;
-            void CreatePaths();
-            void CreateWalls();
+            void DiscardRooms();
+            void ConnectRooms();
+            void RoutePath(PathFinder &finder, std::size_t edge);
+            void StartPaths();
+            void RoutePaths(const GeneratorBudget                *budget,
+                            std::chrono::steady_clock::time_point start);
+            void FinishPaths();
+            void CreateWalls(unsigned int row);
             void PlacePlayer();
-            void PlaceDoors();
-            void PlaceItems();
-            int PathHeuristic (Tile *tile, Tile *goal);
+            void PlaceDoors(unsigned int row);
+            void PlaceItems(unsigned int row);
+            void CreateItems();
+            void PlaceStairs();
+            void StartVisibility();
+            void BuildVisibility(unsigned int row);
+            void FinishVisibility();
             bool RoomOutOfBounds(Room &room, int *adjust_x = NULL, int *adjust_y = NULL);
-            void RoomsToTiles();
+            void RasterizeRoom(const Room &room, int delta);
 
+            GeneratorParams              m_params;
             std::shared_ptr<Map>         m_map;
+            std::vector<std::uint16_t>   m_coverage;
             GeneratorStage               m_stage;
+            bool                         m_stageStarted;
+
+            // How far through the current stage has got: paths routed for
+            // CREATE_PATHS, rows done for the stages that work on rows.
+            std::size_t                  m_progress;
             std::mt19937                 m_randomGen;
             unsigned int                 m_fitProgress;
             std::vector<Room>            m_rooms;
             std::vector<Room>::iterator  m_currentRoom;
             std::vector<Room>            m_collideRooms;
+            RoomGrid                     m_roomGrid;
+            std::vector<unsigned int>    m_candidates;
             std::pair<Room, Room>        m_lastMove;
             bool                         m_foundIntersection;
-            std::vector<graph::Edge>     m_urquhartEdges;
+            std::vector<graph::IndexedEdge> m_roomEdges;
             std::vector<graph::Triangle> m_delaunayTris;
+            std::vector<PathFinder>      m_pathFinders;
+            std::vector<PathFinder::Path> m_edgePaths;
+            std::vector<std::size_t>     m_itemTiles;
+            std::unique_ptr<VisibilitySetBuilder> m_visibilitySets;
     };
 
 
-    class GeneratorGameState : public GameState
-    {
-        public:
-            GeneratorGameState(GameStateManager &manager)
-                : m_manager(manager)
-            {
-            }
-
-            void Draw() const override
-            {
-                m_generator.Draw();
-            }
-
-            void Run() override;
-
-        private:
-            SDL_Renderer     *m_renderer;
-            GameStateManager &m_manager;
-            Generator         m_generator;
-    };
+    /*
+     * DeriveSeed
+     *
+     * Derive the seed for the index'th map of a batch from the batch's master
+     * seed, so that every map gets its own independent random stream.
+     */
+    unsigned int DeriveSeed(unsigned int seed, unsigned int index);
+
+
+    /*
+     * GenerateMaps
+     *
+     * Generate count independent maps across the threads of a pool. Map i is
+     * generated from DeriveSeed(seed, i), so the results do not depend on the
+     * number of threads. The generators do not log, as their output would be
+     * interleaved, and route their corridors on their own thread.
+     *
+     * The first form calls consumer(i, map) as each map finishes - note that
+     * this happens concurrently on the pool's threads, in no particular
+     * order. The second form collects the maps, indexed by i.
+     */
+    void GenerateMaps(
+            const GeneratorParams                                      &params,
+            unsigned int                                                seed,
+            unsigned int                                                count,
+            util::ThreadPool                                           &pool,
+            const std::function<void(unsigned int, std::shared_ptr<Map>)> &consumer);
+
+    std::vector<std::shared_ptr<Map>> GenerateMaps(
+            const GeneratorParams &params,
+            unsigned int           seed,
+            unsigned int           count,
+            util::ThreadPool      &pool);
 }
 
 
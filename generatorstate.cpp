@@ -0,0 +1,129 @@
+#include <SDL2/SDL.h>
+#include <GL/gl.h>
+
+#include "generatorstate.hpp"
+#include "game.hpp"
+
+namespace dungeon
+{
+    void Generator::DrawRoomOutline(const Room &room) const
+    {
+        glBegin(GL_LINE_LOOP);
+            glVertex2i(room.Left() * TILE_WIDTH,
+                       room.Top() * TILE_HEIGHT);
+            glVertex2i(room.Right() * TILE_WIDTH,
+                       room.Top() * TILE_HEIGHT);
+            glVertex2i(room.Right() * TILE_WIDTH,
+                       room.Bottom() * TILE_HEIGHT);
+            glVertex2i(room.Left() * TILE_WIDTH,
+                       room.Bottom() * TILE_HEIGHT);
+        glEnd();
+    }
+
+
+    void Generator::Draw() const
+    {
+        for (std::size_t i = 0; i < m_map->TileCount(); i++) {
+            Tile::TileType type = m_map->GetType(i);
+            if (!Tile::IsEmpty(type)) {
+                if (type == Tile::FLOOR) {
+                    glColor4f(1, 1, 1, 1);
+                } else if (type == Tile::WALL) {
+                    glColor4f(1.0f, 0.5f, 0.5f, 1.0f);
+                } else if (type == Tile::DOOR_CLOSED) {
+                    glColor4f(0.5f, 1.0f, 0.5f, 1.0f);
+                } else if (type == Tile::STAIRS) {
+                    glColor4f(0.9f, 0.8f, 0.2f, 1.0f);
+                }
+
+                unsigned int x = m_map->TileX(i);
+                unsigned int y = m_map->TileY(i);
+                glRecti(x * TILE_WIDTH,
+                        y * TILE_HEIGHT,
+                        (x + 1) * TILE_WIDTH,
+                        (y + 1) * TILE_HEIGHT);
+            }
+        }
+
+        glColor4f(1.0f, 0.0f, 0.0f, 1.0f);
+        for (auto &&tri : m_delaunayTris) {
+            for (auto &&edge : tri.GetEdges()) {
+                glBegin(GL_LINE);
+                    glVertex2i(edge.p1.x * TILE_WIDTH,
+                               edge.p1.y * TILE_HEIGHT);
+                    glVertex2i(edge.p2.x * TILE_WIDTH,
+                               edge.p2.y * TILE_HEIGHT);
+                glEnd();
+            }
+        }
+
+        glColor4f(0.0f, 0.0f, 1.0f, 1.0f);
+        for (auto &&edge : m_roomEdges) {
+            glBegin(GL_LINE);
+                glVertex2i(m_rooms[edge.a].CenterX() * TILE_WIDTH,
+                           m_rooms[edge.a].CenterY() * TILE_HEIGHT);
+                glVertex2i(m_rooms[edge.b].CenterX() * TILE_WIDTH,
+                           m_rooms[edge.b].CenterY() * TILE_HEIGHT);
+            glEnd();
+        }
+
+        if (m_stage == FIT_ROOMS && m_foundIntersection) {
+            glColor4f(0, 0, 1, 0);
+            for (auto &&room : m_collideRooms) {
+                DrawRoomOutline(room);
+            }
+
+            glColor4f(1, 0, 0, 1);
+            DrawRoomOutline(m_lastMove.first);
+            glColor4f(0, 1, 0, 1);
+            DrawRoomOutline(m_lastMove.second);
+
+            int start_x = (m_lastMove.first.Left() + m_lastMove.first.Width() / 2);
+            int start_y = (m_lastMove.first.Top() + m_lastMove.first.Height() / 2);
+            int end_x = (m_lastMove.second.Left() + m_lastMove.second.Width() / 2);
+            int end_y = (m_lastMove.second.Top() + m_lastMove.second.Height() / 2);
+
+            glBegin(GL_LINE);
+            glVertex2i(start_x * TILE_WIDTH,
+                       start_y * TILE_HEIGHT);
+            glVertex2i(end_x * TILE_WIDTH,
+                       end_y * TILE_HEIGHT);
+            glEnd();
+        }
+    }
+
+
+    void GeneratorGameState::Run()
+    {
+        // The time given to the generator each frame when running
+        // continuously, leaving the rest of a 60 fps frame for drawing.
+        const std::chrono::milliseconds FRAME_BUDGET(10);
+
+        SDL_Event e;
+
+        if (SDL_PollEvent(&e)) {
+            if (e.type == SDL_KEYDOWN) {
+                if (e.key.keysym.sym == SDLK_SPACE) {
+                    m_playing = !m_playing;
+                } else if (e.key.keysym.sym == SDLK_RETURN) {
+                    m_generator.Run();
+                } else {
+                    m_generator.Iterate();
+                }
+            }
+        }
+
+        if (m_playing && !m_generator.IsFinished()) {
+            m_generator.Iterate(GeneratorBudget(FRAME_BUDGET));
+        }
+
+        if (m_generator.IsFinished()) {
+            // Switch to a new game gamestate, generating the levels after
+            // this one in the background.
+            m_manager.Replace(std::make_shared<Game>(
+                        m_renderer, m_manager, m_generator.GetMap(),
+                        std::make_shared<LevelQueue>(
+                            Game::LevelParams(), std::random_device{}())));
+        }
+    }
+}
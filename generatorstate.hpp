@@ -0,0 +1,54 @@
+#ifndef __GENERATORSTATE_HPP__
+#define __GENERATORSTATE_HPP__
+
+
+#include <SDL2/SDL.h>
+
+#include "game.hpp"
+#include "generator.hpp"
+#include "gamestate.hpp"
+
+
+namespace dungeon
+{
+    /*
+     * GeneratorGameState
+     *
+     * Shows the generator at work. Any key runs the next stage; space
+     * toggles running the generator continuously, a frame's worth at a
+     * time; return skips straight to the finished level.
+     */
+    class GeneratorGameState : public GameState
+    {
+        public:
+            GeneratorGameState(GameStateManager &manager)
+                : m_manager(manager),
+                  m_generator(LoggedParams(), std::random_device{}()),
+                  m_playing(false)
+            {
+            }
+
+            void Draw() const override
+            {
+                m_generator.Draw();
+            }
+
+            void Run() override;
+
+        private:
+            static GeneratorParams LoggedParams()
+            {
+                GeneratorParams params = Game::LevelParams();
+                params.log = &util::Logger::Default();
+                return params;
+            }
+
+            SDL_Renderer     *m_renderer;
+            GameStateManager &m_manager;
+            Generator         m_generator;
+            bool              m_playing;
+    };
+}
+
+
+#endif
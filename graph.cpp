@@ -1,193 +1,940 @@
 #include <cmath>
 #include <array>
 #include <vector>
-#include <unordered_set>
 #include <algorithm>
 #include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
 
 #include "graph.hpp"
-#include "util.hpp"
 
 
 namespace graph
 {
-    struct {
-        bool operator()(const Vec2f* v1, const Vec2f* v2)
-        {
-            if (v1->x < v2->x) {
-                return true;
-            } else if (v1->x > v2->x) {
-                return false;
-            } else if (v1->y < v2->y) {
-                return true;
-            } else {
-                return false;
+    std::ostream& operator << (std::ostream& os, const Edge& e)
+    {
+        return os << "Edge [(" << e.p1.x << ", " << e.p1.y << "), ("
+            << e.p2.x << ", " << e.p2.y << ")]";
+    }
+
+    std::ostream& operator << (std::ostream& os, const Triangle& t)
+    {
+        return os << "Triangle ["
+            << "(" << t.p1.x << ", " << t.p1.y << "), "
+            << "(" << t.p2.x << ", " << t.p2.y << "), "
+            << "(" << t.p3.x << ", " << t.p3.y << ")] ";
+    }
+
+
+    /*
+     * hilbertIndex
+     *
+     * The distance along a Hilbert curve filling a 65536x65536 grid of the
+     * cell at (x, y). Points sorted by it are close to their neighbours in
+     * the order.
+     */
+    static std::uint64_t hilbertIndex(std::uint32_t x, std::uint32_t y)
+    {
+        const std::uint32_t MAX = 0xffff;
+        std::uint64_t       index = 0;
+
+        for (std::uint32_t s = 0x8000; s > 0; s >>= 1) {
+            std::uint32_t rx = (x & s) != 0;
+            std::uint32_t ry = (y & s) != 0;
+            index += static_cast<std::uint64_t>(s) * s * ((3 * rx) ^ ry);
+
+            // Rotate the quadrant so the curve inside it runs the right way.
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = MAX - x;
+                    y = MAX - y;
+                }
+                std::swap(x, y);
             }
         }
-    } vecLess;
 
+        return index;
+    }
 
-    std::ostream& operator << (std::ostream& os, const Edge& e)
+
+    static inline double squaredDistance(const Vec2f &p1, const Vec2f &p2)
     {
-        return os << "Edge [(" << e.p1.x << ", " << e.p1.y << "), ("
-            << e.p2.x << ", " << e.p2.y << ")]";
+        double dx = static_cast<double>(p1.x) - p2.x;
+        double dy = static_cast<double>(p1.y) - p2.y;
+        return dx * dx + dy * dy;
+    }
+
+
+    /*
+     * longerEdge
+     *
+     * Whether e1 is longer than e2, breaking ties by the points' indices so
+     * that every triangle has exactly one longest edge, wherever it is in
+     * the mesh.
+     */
+    static bool longerEdge(const Triangulation &tri, const IndexedEdge &e1,
+                           const IndexedEdge &e2)
+    {
+        double length1 = squaredDistance(tri.GetPoint(e1.a),
+                                         tri.GetPoint(e1.b));
+        double length2 = squaredDistance(tri.GetPoint(e2.a),
+                                         tri.GetPoint(e2.b));
+        return length1 > length2 || (length1 == length2 && e2 < e1);
+    }
+
+
+    /*
+     * diffEdges
+     *
+     * Add the edges in before but not after to the change's removed edges,
+     * and those in after but not before to its added edges. Both must be
+     * sorted.
+     */
+    static void diffEdges(const std::vector<IndexedEdge>     &before,
+                          const std::vector<IndexedEdge>     &after,
+                          Triangulation::UrquhartChange      *change)
+    {
+        std::set_difference(before.begin(), before.end(),
+                            after.begin(), after.end(),
+                            std::back_inserter(change->removed));
+        std::set_difference(after.begin(), after.end(),
+                            before.begin(), before.end(),
+                            std::back_inserter(change->added));
     }
 
-    struct EdgeHash
+
+    const std::uint32_t Triangulation::NONE;
+    const std::uint32_t Triangulation::SUPER_VERTICES;
+
+
+    Triangulation::Triangulation(const std::vector<Vec2f> &points)
+        : m_lastFace(0), m_mark(0)
     {
-        std::size_t operator()(const Edge &e) const
-        {
-            std::size_t seed = 0;
+        float minX = 0, minY = 0, maxX = 0, maxY = 0;
+        if (!points.empty()) {
+            minX = maxX = points[0].x;
+            minY = maxY = points[0].y;
+        }
+
+        for (auto &&point : points) {
+            minX = std::min(minX, point.x);
+            minY = std::min(minY, point.y);
+            maxX = std::max(maxX, point.x);
+            maxY = std::max(maxY, point.y);
+        }
 
-            // Sort the points so that if there are two edges with the same
-            // points but different order, then hash to the same value.
-            std::array<const Vec2f*, 2> pts = { &e.p1, &e.p2 };
-            std::sort(pts.begin(), pts.end(), vecLess);
+        // A super-triangle far enough out that its vertices have little
+        // effect on the triangulation of the points.
+        float maxD = std::max(std::max(maxX - minX, maxY - minY), 1.0f);
+        float midX = (minX + maxX) / 2.0f;
+        float midY = (minY + maxY) / 2.0f;
 
-            util::hash_combine(seed, pts[0]->x);
-            util::hash_combine(seed, pts[0]->y);
-            util::hash_combine(seed, pts[1]->x);
-            util::hash_combine(seed, pts[1]->y);
+        m_vertices.reserve(SUPER_VERTICES + points.size());
+        m_vertices.push_back(Vec2f(midX - 20 * maxD, midY - maxD));
+        m_vertices.push_back(Vec2f(midX + 20 * maxD, midY - maxD));
+        m_vertices.push_back(Vec2f(midX, midY + 20 * maxD));
+        m_vertices.insert(m_vertices.end(), points.begin(), points.end());
+        m_vertexFaces.resize(m_vertices.size(), NONE);
+
+        std::uint32_t face = NewFace();
+        m_faces[face].v = {{ 0, 1, 2 }};
+        m_faces[face].n = {{ NONE, NONE, NONE }};
+        std::fill(m_vertexFaces.begin(), m_vertexFaces.begin() + SUPER_VERTICES,
+                  face);
+
+        // Insert the points in Hilbert curve order.
+        float scaleX = maxX > minX ? 65535.0f / (maxX - minX) : 0.0f;
+        float scaleY = maxY > minY ? 65535.0f / (maxY - minY) : 0.0f;
+
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> order;
+        order.reserve(points.size());
+        for (std::uint32_t i = 0; i < points.size(); i++) {
+            std::uint32_t x = static_cast<std::uint32_t>(
+                                    (points[i].x - minX) * scaleX);
+            std::uint32_t y = static_cast<std::uint32_t>(
+                                    (points[i].y - minY) * scaleY);
+            order.push_back(std::make_pair(hilbertIndex(x, y), i));
+        }
+        std::sort(order.begin(), order.end());
 
-            return seed;
+        m_faces.reserve(2 * points.size() + 1);
+        for (auto &&entry : order) {
+            InsertVertex(SUPER_VERTICES + entry.second, NULL);
         }
-    };
+    }
 
 
-    std::ostream& operator << (std::ostream& os, const Triangle& t)
+    std::uint32_t Triangulation::Insert(const Vec2f &point,
+                                        UrquhartChange *change)
     {
-        return os << "Triangle ["
-            << "(" << t.p1.x << ", " << t.p1.y << "), "
-            << "(" << t.p2.x << ", " << t.p2.y << "), "
-            << "(" << t.p3.x << ", " << t.p3.y << ")] ";
+        if (change) {
+            change->removed.clear();
+            change->added.clear();
+        }
+
+        // Locate the point first, so that nothing has changed if it is
+        // outside.
+        Locate(point);
+
+        std::uint32_t vertex = static_cast<std::uint32_t>(m_vertices.size());
+        m_vertices.push_back(point);
+        m_vertexFaces.push_back(NONE);
+
+        std::uint32_t inserted = InsertVertex(vertex, change);
+        if (inserted != vertex) {
+            m_vertices.pop_back();
+            m_vertexFaces.pop_back();
+        }
+
+        return inserted - SUPER_VERTICES;
     }
 
-    struct TriangleHash
+
+    void Triangulation::Remove(std::uint32_t point, UrquhartChange *change)
     {
-        std::size_t operator()(const Triangle &t) const
-        {
-            std::size_t seed = 0;
+        if (change) {
+            change->removed.clear();
+            change->added.clear();
+        }
 
-            // Sort the points so that if there are two tris with the same
-            // points but different order, then hash to the same value.
-            std::array<const Vec2f*, 3> pts = { &t.p1, &t.p2, &t.p3 };
-            std::sort(pts.begin(), pts.end(), vecLess);
+        if (point >= PointCount() || !HasPoint(point)) {
+            throw std::runtime_error(
+                        "Removing a point not in the triangulation");
+        }
+
+        RemoveVertex(SUPER_VERTICES + point, change);
+    }
 
-            util::hash_combine(seed, pts[0]->x);
-            util::hash_combine(seed, pts[0]->y);
-            util::hash_combine(seed, pts[1]->x);
-            util::hash_combine(seed, pts[1]->y);
-            util::hash_combine(seed, pts[2]->x);
-            util::hash_combine(seed, pts[2]->y);
 
-            return seed;
+    void Triangulation::Move(std::uint32_t point, const Vec2f &position,
+                             UrquhartChange *change)
+    {
+        if (change) {
+            change->removed.clear();
+            change->added.clear();
         }
-    };
+
+        if (point >= PointCount() || !HasPoint(point)) {
+            throw std::runtime_error(
+                        "Moving a point not in the triangulation");
+        }
+
+        std::uint32_t vertex = SUPER_VERTICES + point;
+        if (m_vertices[vertex] == position) {
+            return;
+        }
+
+        for (auto v : m_faces[Locate(position)].v) {
+            if (m_vertices[v] == position) {
+                throw std::runtime_error("Moving a point onto another point");
+            }
+        }
+
+        // Take the point out and put it back in at its new position, under
+        // the same index.
+        UrquhartChange removal;
+        UrquhartChange insertion;
+        RemoveVertex(vertex, change ? &removal : NULL);
+        m_vertices[vertex] = position;
+        InsertVertex(vertex, change ? &insertion : NULL);
+
+        if (change) {
+            // An edge the insertion added back was only removed for the
+            // moment, and likewise one it removed was only added for it.
+            std::vector<IndexedEdge> kept;
+            std::set_difference(removal.removed.begin(), removal.removed.end(),
+                                insertion.added.begin(), insertion.added.end(),
+                                std::back_inserter(kept));
+            std::set_difference(insertion.removed.begin(),
+                                insertion.removed.end(),
+                                removal.added.begin(), removal.added.end(),
+                                std::back_inserter(kept));
+            std::sort(kept.begin(), kept.end());
+            change->removed.swap(kept);
+
+            kept.clear();
+            std::set_difference(removal.added.begin(), removal.added.end(),
+                                insertion.removed.begin(),
+                                insertion.removed.end(),
+                                std::back_inserter(kept));
+            std::set_difference(insertion.added.begin(), insertion.added.end(),
+                                removal.removed.begin(), removal.removed.end(),
+                                std::back_inserter(kept));
+            std::sort(kept.begin(), kept.end());
+            change->added.swap(kept);
+        }
+    }
+
+
+    std::uint32_t Triangulation::Locate(const Vec2f &point) const
+    {
+        std::uint32_t face = m_lastFace;
+        std::uint32_t from = NONE;
+
+        // Step across any edge the point is on the far side of, never going
+        // straight back, until there are none left.
+        for (;;) {
+            const Face   &f = m_faces[face];
+            std::uint32_t next = NONE;
+
+            for (unsigned int i = 0; i < 3; i++) {
+                if (from != NONE && f.n[i] == from) {
+                    continue;
+                }
+
+                if (orient2d(m_vertices[f.v[(i + 1) % 3]],
+                             m_vertices[f.v[(i + 2) % 3]], point) < 0) {
+                    next = f.n[i];
+                    if (next == NONE) {
+                        throw std::runtime_error(
+                                    "Point outside of the triangulation");
+                    }
+                    break;
+                }
+            }
+
+            if (next == NONE) {
+                return face;
+            }
+
+            from = face;
+            face = next;
+        }
+    }
+
+
+    std::uint32_t Triangulation::InsertVertex(std::uint32_t vertex,
+                                              UrquhartChange *change)
+    {
+        const Vec2f  &point = m_vertices[vertex];
+        std::uint32_t face = Locate(point);
+
+        for (auto v : m_faces[face].v) {
+            if (m_vertices[v] == point) {
+                return v;
+            }
+        }
+
+        // Flood out from the containing face to find the cavity of faces
+        // whose circumcircles contain the point.
+        if (++m_mark == 0) {
+            std::fill(m_faceMarks.begin(), m_faceMarks.end(), 0);
+            m_mark = 1;
+        }
+
+        m_cavity.clear();
+        m_cavity.push_back(face);
+        m_faceMarks[face] = m_mark;
+
+        for (std::size_t i = 0; i < m_cavity.size(); i++) {
+            for (auto neighbour : m_faces[m_cavity[i]].n) {
+                if (neighbour == NONE || m_faceMarks[neighbour] == m_mark) {
+                    continue;
+                }
+
+                const Face &f = m_faces[neighbour];
+                if (incircle(m_vertices[f.v[0]], m_vertices[f.v[1]],
+                             m_vertices[f.v[2]], point) > 0) {
+                    m_faceMarks[neighbour] = m_mark;
+                    m_cavity.push_back(neighbour);
+                }
+            }
+        }
+
+        if (change) {
+            UrquhartEdges(m_cavity, &m_urquhartBefore);
+        }
+
+        m_cavityEdges.clear();
+        for (auto inner : m_cavity) {
+            const Face &f = m_faces[inner];
+            for (unsigned int i = 0; i < 3; i++) {
+                if (f.n[i] != NONE && m_faceMarks[f.n[i]] == m_mark) {
+                    continue;
+                }
+
+                CavityEdge edge = {
+                    f.v[(i + 1) % 3], f.v[(i + 2) % 3], f.n[i], 0
+                };
+                if (edge.outer != NONE) {
+                    const Face &outer = m_faces[edge.outer];
+                    while (outer.n[edge.outerSlot] != inner) {
+                        edge.outerSlot++;
+                    }
+                }
+                m_cavityEdges.push_back(edge);
+            }
+        }
+
+        for (auto inner : m_cavity) {
+            m_faces[inner].v.fill(NONE);
+            m_freeFaces.push_back(inner);
+        }
+
+        // Fan the cavity's edges out to the new vertex.
+        m_cavity.clear();
+        for (auto &&edge : m_cavityEdges) {
+            std::uint32_t created = NewFace();
+            m_faces[created].v = {{ vertex, edge.a, edge.b }};
+            Link(created, 0, edge.outer, edge.outerSlot);
+
+            m_vertexFaces[edge.a] = created;
+            m_cavity.push_back(created);
+        }
+
+        // Each new face's neighbour across its edge from b to the new vertex
+        // is the new face starting at b.
+        for (auto created : m_cavity) {
+            std::uint32_t next = m_vertexFaces[m_faces[created].v[2]];
+            Link(created, 1, next, 2);
+        }
+
+        m_lastFace = m_cavity.back();
+        m_vertexFaces[vertex] = m_lastFace;
+
+        if (change) {
+            UrquhartEdges(m_cavity, &m_urquhartAfter);
+            diffEdges(m_urquhartBefore, m_urquhartAfter, change);
+        }
+
+        return vertex;
+    }
+
+
+    void Triangulation::RemoveVertex(std::uint32_t vertex,
+                                     UrquhartChange *change)
+    {
+        // Walk anticlockwise around the vertex, collecting the faces around
+        // it and the polygon they leave behind, with the face outside each
+        // of its edges.
+        std::uint32_t start = m_vertexFaces[vertex];
+        std::uint32_t face = start;
+
+        m_cavity.clear();
+        m_cavityEdges.clear();
+        do {
+            const Face  &f = m_faces[face];
+            unsigned int i = 0;
+            while (f.v[i] != vertex) {
+                i++;
+            }
+
+            CavityEdge edge = {
+                f.v[(i + 1) % 3], f.v[(i + 2) % 3], f.n[i], 0
+            };
+            if (edge.outer != NONE) {
+                const Face &outer = m_faces[edge.outer];
+                while (outer.n[edge.outerSlot] != face) {
+                    edge.outerSlot++;
+                }
+            }
+
+            m_cavity.push_back(face);
+            m_cavityEdges.push_back(edge);
+            face = f.n[(i + 1) % 3];
+        } while (face != start);
+
+        if (change) {
+            UrquhartEdges(m_cavity, &m_urquhartBefore);
+        }
+
+        for (auto inner : m_cavity) {
+            m_faces[inner].v.fill(NONE);
+            m_freeFaces.push_back(inner);
+        }
+        m_vertexFaces[vertex] = NONE;
+
+        // Fill the polygon by cutting off ears, triangles of three of its
+        // vertices in a row whose circumcircles hold none of the others and
+        // so are Delaunay. Each ear leaves an edge across its base with the
+        // ear outside it.
+        m_cavity.clear();
+        std::size_t ear = 0;
+        std::size_t tried = 0;
+        while (m_cavityEdges.size() > 3) {
+            std::size_t size = m_cavityEdges.size();
+            std::size_t next = (ear + 1) % size;
+            const CavityEdge &first = m_cavityEdges[ear];
+            const CavityEdge &second = m_cavityEdges[next];
+            const Vec2f &a = m_vertices[first.a];
+            const Vec2f &b = m_vertices[first.b];
+            const Vec2f &c = m_vertices[second.b];
+
+            bool isEar = orient2d(a, b, c) > 0;
+            for (std::size_t i = (ear + 2) % size;
+                 isEar && (i + 1) % size != ear; i = (i + 1) % size) {
+                isEar = incircle(a, b, c, m_vertices[m_cavityEdges[i].b]) <= 0;
+            }
+
+            if (!isEar) {
+                if (++tried == size) {
+                    throw std::runtime_error(
+                                "No ear left filling a removed point's hole");
+                }
+                ear = next;
+                continue;
+            }
+
+            std::uint32_t created = NewFace();
+            m_faces[created].v = {{ first.a, first.b, second.b }};
+            Link(created, 0, second.outer, second.outerSlot);
+            Link(created, 2, first.outer, first.outerSlot);
+            m_faces[created].n[1] = NONE;
+            m_vertexFaces[first.b] = created;
+            m_cavity.push_back(created);
+
+            CavityEdge base = { first.a, second.b, created, 1 };
+            m_cavityEdges[ear] = base;
+            m_cavityEdges.erase(m_cavityEdges.begin() + next);
+            if (next < ear) {
+                ear--;
+            }
+            tried = 0;
+        }
+
+        std::uint32_t created = NewFace();
+        m_faces[created].v = {{
+            m_cavityEdges[0].a, m_cavityEdges[1].a, m_cavityEdges[2].a
+        }};
+        for (unsigned int i = 0; i < 3; i++) {
+            const CavityEdge &edge = m_cavityEdges[(i + 1) % 3];
+            Link(created, i, edge.outer, edge.outerSlot);
+            m_vertexFaces[m_faces[created].v[i]] = created;
+        }
+        m_cavity.push_back(created);
+        m_lastFace = created;
+
+        if (change) {
+            UrquhartEdges(m_cavity, &m_urquhartAfter);
+            diffEdges(m_urquhartBefore, m_urquhartAfter, change);
+        }
+    }
+
+
+    std::uint32_t Triangulation::NewFace()
+    {
+        if (!m_freeFaces.empty()) {
+            std::uint32_t face = m_freeFaces.back();
+            m_freeFaces.pop_back();
+            return face;
+        }
+
+        m_faces.push_back(Face());
+        m_faceMarks.push_back(0);
+        return static_cast<std::uint32_t>(m_faces.size() - 1);
+    }
+
+
+    void Triangulation::Link(std::uint32_t face, unsigned int slot,
+                             std::uint32_t neighbour,
+                             unsigned int neighbourSlot)
+    {
+        m_faces[face].n[slot] = neighbour;
+        if (neighbour != NONE) {
+            m_faces[neighbour].n[neighbourSlot] = face;
+        }
+    }
+
+
+    bool Triangulation::IsLongestEdge(std::uint32_t face,
+                                      unsigned int slot) const
+    {
+        const Face &f = m_faces[face];
+        if (IsSuperVertex(f.v[0]) || IsSuperVertex(f.v[1]) ||
+            IsSuperVertex(f.v[2])) {
+            return false;
+        }
+
+        IndexedEdge edges[3];
+        for (unsigned int i = 0; i < 3; i++) {
+            edges[i] = IndexedEdge(f.v[(i + 1) % 3] - SUPER_VERTICES,
+                                   f.v[(i + 2) % 3] - SUPER_VERTICES);
+        }
+
+        return longerEdge(*this, edges[slot], edges[(slot + 1) % 3]) &&
+               longerEdge(*this, edges[slot], edges[(slot + 2) % 3]);
+    }
+
+
+    bool Triangulation::IsUrquhartEdge(std::uint32_t face,
+                                       unsigned int slot) const
+    {
+        // An edge is kept unless it is the longest of a triangle beside it.
+        const Face &f = m_faces[face];
+        if (IsSuperVertex(f.v[(slot + 1) % 3]) ||
+            IsSuperVertex(f.v[(slot + 2) % 3]) || IsLongestEdge(face, slot)) {
+            return false;
+        }
+
+        std::uint32_t neighbour = f.n[slot];
+        if (neighbour == NONE) {
+            return true;
+        }
+
+        unsigned int neighbourSlot = 0;
+        while (m_faces[neighbour].n[neighbourSlot] != face) {
+            neighbourSlot++;
+        }
+        return !IsLongestEdge(neighbour, neighbourSlot);
+    }
+
+
+    void Triangulation::UrquhartEdges(const std::vector<std::uint32_t> &faces,
+                                      std::vector<IndexedEdge> *edges) const
+    {
+        edges->clear();
+        for (auto face : faces) {
+            for (unsigned int i = 0; i < 3; i++) {
+                if (IsUrquhartEdge(face, i)) {
+                    const Face &f = m_faces[face];
+                    edges->push_back(
+                            IndexedEdge(f.v[(i + 1) % 3] - SUPER_VERTICES,
+                                        f.v[(i + 2) % 3] - SUPER_VERTICES));
+                }
+            }
+        }
+
+        std::sort(edges->begin(), edges->end());
+        edges->erase(std::unique(edges->begin(), edges->end()), edges->end());
+    }
+
+
+    std::vector<Triangle> Triangulation::GetTriangles() const
+    {
+        std::vector<Triangle> tris;
+
+        for (auto &&face : m_faces) {
+            if (face.v[0] == NONE || IsSuperVertex(face.v[0]) ||
+                IsSuperVertex(face.v[1]) || IsSuperVertex(face.v[2])) {
+                continue;
+            }
+
+            tris.push_back(Triangle(m_vertices[face.v[0]],
+                                    m_vertices[face.v[1]],
+                                    m_vertices[face.v[2]]));
+        }
+
+        return tris;
+    }
 
 
     /*
-     * findSuperTriangle
+     * MeshEdges
      *
-     * Finds the super-triangle which encloses a given set of points in the 2D
-     * plane. The points of the triangle will be in clockwise order.
+     * The edges between the points of a triangulation, numbered, with the
+     * edge along each side of each face and the vertices opposite each edge.
      */
-    static Triangle findSuperTriangle(std::vector<Vec2f> &vertices)
+    struct MeshEdges
     {
-        float minX = vertices[0].x;
-        float minY = vertices[0].y;
-        float maxX = minX;
-        float maxY = minY;
+        std::vector<IndexedEdge>                  edges;
+
+        // The edge along the side opposite each face's i'th vertex is
+        // faceEdges[face * 3 + i], or NONE if it touches the super-triangle.
+        std::vector<std::uint32_t>                faceEdges;
+
+        // The points opposite each edge in the faces either side of it, or
+        // NONE where that is a vertex of the super-triangle.
+        std::vector<std::array<std::uint32_t, 2>> opposite;
+    };
+
+
+    static MeshEdges indexEdges(const Triangulation &tri)
+    {
+        const std::uint32_t NONE = Triangulation::NONE;
+        const std::uint32_t SUPER = Triangulation::SUPER_VERTICES;
+        const auto         &faces = tri.GetFaces();
+        MeshEdges           mesh;
+
+        mesh.faceEdges.assign(faces.size() * 3, NONE);
+        mesh.edges.reserve(tri.PointCount() * 3);
+        mesh.opposite.reserve(tri.PointCount() * 3);
+
+        for (std::uint32_t face = 0; face < faces.size(); face++) {
+            const Triangulation::Face &f = faces[face];
+            if (f.v[0] == NONE) {
+                continue;
+            }
+
+            for (unsigned int i = 0; i < 3; i++) {
+                std::uint32_t a = f.v[(i + 1) % 3];
+                std::uint32_t b = f.v[(i + 2) % 3];
+                std::uint32_t neighbour = f.n[i];
 
-        for (auto&& vert : vertices) {
-            float x = vert.x;
-            float y = vert.y;
+                // Number each edge from the lower numbered face beside it.
+                if (tri.IsSuperVertex(a) || tri.IsSuperVertex(b) ||
+                    (neighbour != NONE && neighbour < face)) {
+                    continue;
+                }
 
-            if (x < minX) { minX = x; }
-            if (y < minY) { minY = y; }
-            if (x > maxX) { maxX = x; }
-            if (y > minY) { maxY = y; }
+                std::uint32_t edge = static_cast<std::uint32_t>(
+                                        mesh.edges.size());
+                std::array<std::uint32_t, 2> opposite = {{
+                    tri.IsSuperVertex(f.v[i]) ? NONE : f.v[i] - SUPER, NONE
+                }};
+
+                mesh.faceEdges[face * 3 + i] = edge;
+                if (neighbour != NONE) {
+                    const Triangulation::Face &n = faces[neighbour];
+                    for (unsigned int j = 0; j < 3; j++) {
+                        if (n.n[j] == face) {
+                            mesh.faceEdges[neighbour * 3 + j] = edge;
+                            if (!tri.IsSuperVertex(n.v[j])) {
+                                opposite[1] = n.v[j] - SUPER;
+                            }
+                        }
+                    }
+                }
+
+                mesh.edges.push_back(IndexedEdge(a - SUPER, b - SUPER));
+                mesh.opposite.push_back(opposite);
+            }
         }
 
-        float dx = maxX - minX;
-        float dy = maxY - minY;
-        float maxD = std::max(dx, dy);
-        float midX = (minX + maxX) / 2.0f;
-        float midY = (minY + maxY) / 2.0f;
+        return mesh;
+    }
+
 
-        return Triangle(Vec2f(midX - 20 * maxD, midY - maxD),
-                        Vec2f(midX, midY + 20 * maxD),
-                        Vec2f(midX + 20 * maxD, midY - maxD));
+    std::vector<IndexedEdge> Triangulation::GetEdges() const
+    {
+        return indexEdges(*this).edges;
     }
 
 
     /*
-     * generateDelaunay
+     * keepEdges
      *
-     * See function declaration for more detail.
+     * The edges of a mesh that are not marked for removal.
      */
-    std::vector<Triangle>
-    generateDelaunay(std::vector<Vec2f> &vertices)
+    static std::vector<IndexedEdge> keepEdges(const MeshEdges        &mesh,
+                                              const std::vector<bool> &removed)
     {
-        std::vector<Triangle> tris;
+        std::vector<IndexedEdge> result;
+        for (std::size_t i = 0; i < mesh.edges.size(); i++) {
+            if (!removed[i]) {
+                result.push_back(mesh.edges[i]);
+            }
+        }
+        return result;
+    }
+
 
-        // Find the super-triangle and add it to the list of tris.
-        Triangle superTri = findSuperTriangle(vertices);
-        tris.push_back(superTri);
+    static std::vector<IndexedEdge> gabrielGraph(const Triangulation &tri,
+                                                 const MeshEdges     &mesh)
+    {
+        // A Delaunay edge's diametral circle is empty unless one of the
+        // points opposite it sees it at a right or obtuse angle.
+        std::vector<bool> removed(mesh.edges.size(), false);
 
-        // Insert vertices into the mesh one at a time.
-        for (auto&& v : vertices) {
-            std::unordered_set<Triangle, TriangleHash> badTris;
+        for (std::size_t i = 0; i < mesh.edges.size(); i++) {
+            const Vec2f &a = tri.GetPoint(mesh.edges[i].a);
+            const Vec2f &b = tri.GetPoint(mesh.edges[i].b);
+
+            for (auto point : mesh.opposite[i]) {
+                if (point == Triangulation::NONE) {
+                    continue;
+                }
 
-            // Find all the tris that are no longer valid once the current
-            // vertex is inserted.
-            for (auto &&tri : tris) {
-                if (tri.circumcircleContains(v)) {
-                    badTris.insert(tri);
+                const Vec2f &c = tri.GetPoint(point);
+                double       dot = (static_cast<double>(a.x) - c.x) *
+                                   (static_cast<double>(b.x) - c.x) +
+                                   (static_cast<double>(a.y) - c.y) *
+                                   (static_cast<double>(b.y) - c.y);
+                if (dot <= 0) {
+                    removed[i] = true;
                 }
             }
+        }
 
-            std::vector<Edge> poly;
+        return keepEdges(mesh, removed);
+    }
 
-            std::unordered_set<Edge, EdgeHash> edges;
-            std::unordered_set<Edge, EdgeHash> duplicateEdges;
 
-            // Find all unique edges in the bad tris and add them to the poly.
-            for (auto &&tri : badTris) {
-                for (auto &&edge : tri.GetEdges()) {
-                    if (edges.find(edge) != edges.end()) {
-                        duplicateEdges.insert(edge);
-                    } else {
-                        edges.insert(edge);
-                    }
+    static std::vector<IndexedEdge> urquhartGraph(const Triangulation &tri,
+                                                  const MeshEdges     &mesh)
+    {
+        // Remove the longest edge of each triangle.
+        std::vector<bool> removed(mesh.edges.size(), false);
+        const auto       &faces = tri.GetFaces();
+
+        for (std::size_t face = 0; face < faces.size(); face++) {
+            const std::uint32_t *edges = &mesh.faceEdges[face * 3];
+            if (edges[0] == Triangulation::NONE ||
+                edges[1] == Triangulation::NONE ||
+                edges[2] == Triangulation::NONE) {
+                continue;
+            }
+
+            std::uint32_t longest = edges[0];
+            for (unsigned int i = 1; i < 3; i++) {
+                if (longerEdge(tri, mesh.edges[edges[i]],
+                               mesh.edges[longest])) {
+                    longest = edges[i];
                 }
             }
 
-            for (auto &&edge : edges) {
-                if (duplicateEdges.find(edge) == duplicateEdges.end()) {
-                    poly.push_back(edge);
+            removed[longest] = true;
+        }
+
+        return keepEdges(mesh, removed);
+    }
+
+
+    static std::vector<IndexedEdge>
+    relativeNeighbourhoodGraph(const Triangulation &tri, const MeshEdges &mesh)
+    {
+        // A point in the lune of edge ab, closer to both a and b than they
+        // are to each other, need not be a Delaunay neighbour of either.
+        // But the Gabriel graph, and so the triangulation, has a path from a
+        // to it within the circle on their diameter, all of whose points are
+        // closer to a than b is, so searching those finds it.
+        std::size_t                points = tri.PointCount();
+        std::vector<std::uint32_t> offsets(points + 1, 0);
+        std::vector<std::uint32_t> neighbours(mesh.edges.size() * 2);
+
+        for (auto &&edge : mesh.edges) {
+            offsets[edge.a + 1]++;
+            offsets[edge.b + 1]++;
+        }
+        for (std::size_t i = 0; i < points; i++) {
+            offsets[i + 1] += offsets[i];
+        }
+
+        std::vector<std::uint32_t> next(offsets.begin(), offsets.end() - 1);
+        for (auto &&edge : mesh.edges) {
+            neighbours[next[edge.a]++] = edge.b;
+            neighbours[next[edge.b]++] = edge.a;
+        }
+
+        std::vector<bool>          removed(mesh.edges.size(), false);
+        std::vector<std::uint32_t> visited(points, 0);
+        std::vector<std::uint32_t> queue;
+
+        for (std::uint32_t i = 0; i < mesh.edges.size(); i++) {
+            const IndexedEdge &edge = mesh.edges[i];
+            const Vec2f       &a = tri.GetPoint(edge.a);
+            const Vec2f       &b = tri.GetPoint(edge.b);
+            double             length = squaredDistance(a, b);
+
+            // Search outwards from a through the points closer to it than b
+            // is, stopping at the first that is also closer to b.
+            queue.clear();
+            queue.push_back(edge.a);
+            visited[edge.a] = i + 1;
+
+            for (std::size_t head = 0; head < queue.size() && !removed[i];
+                 head++) {
+                std::uint32_t point = queue[head];
+                for (std::uint32_t j = offsets[point];
+                     j < offsets[point + 1]; j++) {
+                    std::uint32_t neighbour = neighbours[j];
+                    const Vec2f  &c = tri.GetPoint(neighbour);
+
+                    if (visited[neighbour] == i + 1 ||
+                        squaredDistance(a, c) >= length) {
+                        continue;
+                    }
+
+                    if (squaredDistance(b, c) < length) {
+                        removed[i] = true;
+                        break;
+                    }
+
+                    visited[neighbour] = i + 1;
+                    queue.push_back(neighbour);
                 }
             }
+        }
 
-            // Remove the bad triangles from the list of tris.
-            tris.erase(std::remove_if(
-                tris.begin(), tris.end(), [badTris](Triangle t) {
-                    return badTris.find(t) != badTris.end();
-                }), tris.end());
+        return keepEdges(mesh, removed);
+    }
+
+
+    static std::vector<IndexedEdge> spanningTree(const Triangulation &tri,
+                                                 const MeshEdges     &mesh,
+                                                 unsigned int         extraEdges)
+    {
+        // Kruskal's algorithm: take the edges shortest first, keeping those
+        // that join two separate trees, then top up with the shortest of
+        // the edges that were passed over.
+        std::vector<std::pair<double, std::uint32_t>> order;
+        order.reserve(mesh.edges.size());
+        for (std::uint32_t i = 0; i < mesh.edges.size(); i++) {
+            const IndexedEdge &edge = mesh.edges[i];
+            order.push_back(std::make_pair(
+                                squaredDistance(tri.GetPoint(edge.a),
+                                                tri.GetPoint(edge.b)), i));
+        }
+        std::sort(order.begin(), order.end());
 
-            // Create new triangles from the current vertex and the edges of
-            // the polygon, and add them to the list of tris.
-            for (auto &&edge : poly) {
-                tris.push_back(Triangle(v, edge.p1, edge.p2));
+        std::vector<std::uint32_t> parent(tri.PointCount());
+        for (std::uint32_t i = 0; i < parent.size(); i++) {
+            parent[i] = i;
+        }
+
+        auto findRoot = [&parent](std::uint32_t point) {
+            while (parent[point] != point) {
+                parent[point] = parent[parent[point]];
+                point = parent[point];
+            }
+            return point;
+        };
+
+        std::vector<IndexedEdge> result;
+        std::vector<IndexedEdge> extra;
+        for (auto &&entry : order) {
+            const IndexedEdge &edge = mesh.edges[entry.second];
+            std::uint32_t      rootA = findRoot(edge.a);
+            std::uint32_t      rootB = findRoot(edge.b);
+
+            if (rootA != rootB) {
+                parent[rootA] = rootB;
+                result.push_back(edge);
+            } else if (extra.size() < extraEdges) {
+                extra.push_back(edge);
             }
         }
 
-        // Remove any triangles that contain a vertex from the super-triangle.
-        tris.erase(std::remove_if(tris.begin(), tris.end(),
-            [superTri](const Triangle &tri) {
-                return superTri.hasCommonPoints(tri);
-            }), tris.end());
-        
-        return tris;
+        result.insert(result.end(), extra.begin(), extra.end());
+        return result;
+    }
+
+
+    /*
+     * generateGraph
+     *
+     * See function declaration for more detail.
+     */
+    std::vector<IndexedEdge>
+    generateGraph(const Triangulation &tri, GraphType type,
+                  unsigned int extraEdges)
+    {
+        MeshEdges mesh = indexEdges(tri);
+
+        switch (type) {
+        case GABRIEL:
+            return gabrielGraph(tri, mesh);
+        case URQUHART:
+            return urquhartGraph(tri, mesh);
+        case RELATIVE_NEIGHBOURHOOD:
+            return relativeNeighbourhoodGraph(tri, mesh);
+        case SPANNING_TREE:
+            return spanningTree(tri, mesh, extraEdges);
+        default:
+            throw std::runtime_error("Unknown graph type");
+        }
+    }
+
+
+    /*
+     * generateDelaunay
+     *
+     * See function declaration for more detail.
+     */
+    std::vector<Triangle>
+    generateDelaunay(std::vector<Vec2f> &vertices)
+    {
+        return Triangulation(vertices).GetTriangles();
     }
 
 
@@ -199,30 +946,13 @@ namespace graph
     std::vector<Edge>
     generateUrquhart(std::vector<Vec2f> &vertices)
     {
-        std::vector<Triangle> delaunayTris = generateDelaunay(vertices);
-
-        // Generate the set of edges of the delaunay triangles.
-        std::unordered_set<Edge, EdgeHash> edges;
-        for (auto &&tri : delaunayTris) {
-            auto triEdges = tri.GetEdges();
-            edges.insert(triEdges.begin(), triEdges.end());
-        }
-
-        // Remove the longest edge from each triangle from the set to give the
-        // Urquhart graph.
-        for (auto &&tri : delaunayTris) {
-            auto triEdges = tri.GetEdges();
-            auto &longestEdge =
-                *std::max_element(triEdges.begin(), triEdges.end(),
-                                [](const Edge &e1, const Edge &e2) {
-                                    return e1.Length() < e2.Length();
-                                });
+        Triangulation     tri(vertices);
+        std::vector<Edge> result;
 
-            edges.erase(longestEdge);
+        for (auto &&edge : generateGraph(tri, URQUHART)) {
+            result.push_back(Edge(tri.GetPoint(edge.a), tri.GetPoint(edge.b)));
         }
 
-        std::vector<Edge> result;
-        result.assign(edges.begin(), edges.end());
         return result;
     }
 }
@@ -2,6 +2,8 @@
 #define __GRAPH_HPP_
 
 #include <array>
+#include <cstdint>
+#include <ostream>
 #include <vector>
 #include <cmath>
 
@@ -70,6 +72,134 @@ namespace graph {
     }
 
 
+    /*
+     * IndexedEdge
+     *
+     * An edge between two of the points a graph was built from, given by
+     * their indices, with the lower index first.
+     */
+    struct IndexedEdge
+    {
+        IndexedEdge() : a(0), b(0) {}
+        IndexedEdge(std::uint32_t a, std::uint32_t b)
+            : a(a < b ? a : b), b(a < b ? b : a)
+        {
+        }
+
+        std::uint32_t a;
+        std::uint32_t b;
+    };
+
+    static inline bool operator == (const IndexedEdge &e1,
+                                     const IndexedEdge &e2) {
+        return e1.a == e2.a && e1.b == e2.b;
+    }
+
+    static inline bool operator != (const IndexedEdge &e1,
+                                     const IndexedEdge &e2) {
+        return !operator==(e1, e2);
+    }
+
+    static inline bool operator < (const IndexedEdge &e1,
+                                    const IndexedEdge &e2) {
+        return e1.a < e2.a || (e1.a == e2.a && e1.b < e2.b);
+    }
+
+
+    /*
+     * orient2dExact, incircleExact
+     *
+     * orient2d and incircle worked out in exact arithmetic, for when the
+     * floating point result is too close to zero to trust.
+     */
+    double orient2dExact(const Vec2f &a, const Vec2f &b, const Vec2f &c);
+    double incircleExact(const Vec2f &a, const Vec2f &b, const Vec2f &c,
+                         const Vec2f &d);
+
+
+    /*
+     * orient2d
+     *
+     * Positive if a, b and c are in anticlockwise order, negative if they
+     * are clockwise and zero if they are collinear. The sign is always
+     * correct: the result is computed in doubles, and only worked out
+     * exactly when it is within the rounding error of zero.
+     */
+    static inline double orient2d(const Vec2f &a, const Vec2f &b,
+                                  const Vec2f &c)
+    {
+        // (3 + 16e)e for e = 2^-53, from Shewchuk's "Adaptive Precision
+        // Floating-Point Arithmetic and Fast Robust Geometric Predicates".
+        const double ERROR_BOUND = 3.3306690738754716e-16;
+
+        double detLeft = (static_cast<double>(a.x) - c.x) *
+                         (static_cast<double>(b.y) - c.y);
+        double detRight = (static_cast<double>(a.y) - c.y) *
+                          (static_cast<double>(b.x) - c.x);
+        double det = detLeft - detRight;
+
+        // Terms of opposite sign cannot cancel each other out.
+        if ((detLeft > 0 && detRight <= 0) || (detLeft < 0 && detRight >= 0) ||
+            detLeft == 0) {
+            return det;
+        }
+
+        double bound = ERROR_BOUND * std::fabs(detLeft + detRight);
+        if (det >= bound || -det >= bound) {
+            return det;
+        }
+
+        return orient2dExact(a, b, c);
+    }
+
+
+    /*
+     * incircle
+     *
+     * Positive if d lies inside the circle through the anticlockwise points
+     * a, b and c, negative if it lies outside and zero if it is on it. Like
+     * orient2d, the sign is always correct.
+     */
+    static inline double incircle(const Vec2f &a, const Vec2f &b,
+                                  const Vec2f &c, const Vec2f &d)
+    {
+        // (10 + 96e)e for e = 2^-53.
+        const double ERROR_BOUND = 1.1102230246251577e-15;
+
+        double adx = static_cast<double>(a.x) - d.x;
+        double ady = static_cast<double>(a.y) - d.y;
+        double bdx = static_cast<double>(b.x) - d.x;
+        double bdy = static_cast<double>(b.y) - d.y;
+        double cdx = static_cast<double>(c.x) - d.x;
+        double cdy = static_cast<double>(c.y) - d.y;
+
+        double bdxcdy = bdx * cdy;
+        double cdxbdy = cdx * bdy;
+        double cdxady = cdx * ady;
+        double adxcdy = adx * cdy;
+        double adxbdy = adx * bdy;
+        double bdxady = bdx * ady;
+
+        double aLift = adx * adx + ady * ady;
+        double bLift = bdx * bdx + bdy * bdy;
+        double cLift = cdx * cdx + cdy * cdy;
+
+        double det = aLift * (bdxcdy - cdxbdy) +
+                     bLift * (cdxady - adxcdy) +
+                     cLift * (adxbdy - bdxady);
+        double permanent = (std::fabs(bdxcdy) + std::fabs(cdxbdy)) * aLift +
+                           (std::fabs(cdxady) + std::fabs(adxcdy)) * bLift +
+                           (std::fabs(adxbdy) + std::fabs(bdxady)) * cLift;
+
+        double bound = ERROR_BOUND * permanent;
+        if (det > bound || -det > bound) {
+            return det;
+        }
+
+        return incircleExact(a, b, c, d);
+    }
+
+
     /*
      * Triangle
      *
@@ -78,44 +208,25 @@ namespace graph {
      */
     class Triangle
     {
-        friend struct TriangleHash;
         friend std::ostream& operator << (std::ostream& os, const Triangle& t);
 
         public:
             Triangle() {}
 
-            Triangle(const Triangle &t)
-                : p1(t.p1), p2(t.p2), p3(t.p3),
-                  edges{{t.edges[0], t.edges[1], t.edges[2]}},
-                  circumcenter(t.circumcenter), circumradius(t.circumradius)
-            {
-            }
-
             Triangle(const Vec2f &p1, const Vec2f &p2, const Vec2f &p3)
                 : p1(p1), p2(p2), p3(p3),
                   edges{{Edge(p1, p2), Edge(p2, p3), Edge(p3, p1)}}
             {
-                float ab = (p1.x * p1.x) + (p1.y * p1.y);
-                float cd = (p2.x * p2.x) + (p2.y * p2.y);
-                float ef = (p3.x * p3.x) + (p3.y * p3.y);
-
-                circumcenter.x =
-                    (ab * (p3.y - p2.y) + cd * (p1.y - p3.y) + ef * (p2.y - p1.y))
-                    / (p1.x * (p3.y - p2.y) + p2.x * (p1.y - p3.y) + p3.x * (p2.y - p1.y))
-                    / 2.0f;
-                circumcenter.y =
-                    (ab * (p3.x - p2.x) + cd * (p1.x - p3.x) + ef * (p2.x - p1.x))
-                    / (p1.y * (p3.x - p2.x) + p2.y * (p1.x - p3.x) + p3.y * (p2.x - p1.x))
-                    / 2.0f;
-
-                circumradius = (p1 - circumcenter).Magnitude();
             }
 
             bool circumcircleContains(const Vec2f &v) const
             {
-                // Distance between circumcenter and point 
-                float distance = (v - circumcenter).Magnitude();
-                return distance <= circumradius;
+                // Points on the circle count as inside it.
+                if (orient2d(p1, p2, p3) > 0) {
+                    return incircle(p1, p2, p3, v) >= 0;
+                } else {
+                    return incircle(p1, p3, p2, v) >= 0;
+                }
             }
 
             bool hasCommonPoints(const Triangle &t) const
@@ -142,8 +253,156 @@ namespace graph {
             Vec2f p2;
             Vec2f p3;
             std::array<Edge, 3> edges;
-            Vec2f circumcenter;
-            float circumradius;
+    };
+
+
+    /*
+     * Triangulation
+     *
+     * A Delaunay triangulation stored as indexed faces, each linked to its
+     * neighbours. A point is inserted by walking across faces from the last
+     * one created to the face containing the point, then re-triangulating
+     * the cavity of faces whose circumcircles contain it. The constructor
+     * inserts points along a space-filling curve so that each walk starts
+     * close to its target, giving expected O(n log n) construction.
+     *
+     * The points are enclosed in a super-triangle, whose vertices come
+     * first; vertex SUPER_VERTICES + i is the i'th point given.
+     *
+     * Points can be added, removed and moved afterwards. Only the faces
+     * around the point are re-triangulated, and the changes to the Urquhart
+     * graph are reported so that a caller only has to act on those. Point
+     * indices stay the same throughout, with removed points leaving gaps.
+     */
+    class Triangulation
+    {
+        public:
+            static const std::uint32_t NONE = 0xffffffff;
+            static const std::uint32_t SUPER_VERTICES = 3;
+
+            // The Urquhart graph edges a change removed and added.
+            struct UrquhartChange
+            {
+                std::vector<IndexedEdge> removed;
+                std::vector<IndexedEdge> added;
+            };
+
+            struct Face
+            {
+                // Vertices in anticlockwise order, and the neighbouring
+                // face across the edge opposite each vertex (NONE on the
+                // outside of the super-triangle). A removed face has NONE
+                // vertices.
+                std::array<std::uint32_t, 3> v;
+                std::array<std::uint32_t, 3> n;
+            };
+
+            explicit Triangulation(const std::vector<Vec2f> &points);
+
+            // Insert a point inside the super-triangle, returning its index,
+            // or the index of the existing point at the same position.
+            std::uint32_t Insert(const Vec2f &point,
+                                 UrquhartChange *change = NULL);
+
+            // Remove a point, leaving its index unused.
+            void Remove(std::uint32_t point, UrquhartChange *change = NULL);
+
+            // Move a point to a new position inside the super-triangle, that
+            // no other point is at.
+            void Move(std::uint32_t point, const Vec2f &position,
+                      UrquhartChange *change = NULL);
+
+            // Find the face containing a point inside the super-triangle.
+            std::uint32_t Locate(const Vec2f &point) const;
+
+            bool IsSuperVertex(std::uint32_t vertex) const
+            {
+                return vertex < SUPER_VERTICES;
+            }
+
+            const Vec2f & GetVertex(std::uint32_t vertex) const
+            {
+                return m_vertices[vertex];
+            }
+
+            std::size_t VertexCount() const
+            {
+                return m_vertices.size();
+            }
+
+            // The points given to the constructor, which are the vertices
+            // after the super-triangle's.
+            const Vec2f & GetPoint(std::uint32_t point) const
+            {
+                return m_vertices[SUPER_VERTICES + point];
+            }
+
+            // The number of point indices, including those of removed
+            // points.
+            std::size_t PointCount() const
+            {
+                return m_vertices.size() - SUPER_VERTICES;
+            }
+
+            bool HasPoint(std::uint32_t point) const
+            {
+                return m_vertexFaces[SUPER_VERTICES + point] != NONE;
+            }
+
+            const std::vector<Face> & GetFaces() const
+            {
+                return m_faces;
+            }
+
+            // The faces that do not touch the super-triangle.
+            std::vector<Triangle> GetTriangles() const;
+
+            // The edges between points, which are the edges of the faces
+            // GetTriangles returns.
+            std::vector<IndexedEdge> GetEdges() const;
+
+        private:
+            // An edge of the cavity made by inserting a vertex, anticlockwise
+            // around the cavity, with the face outside it and which of that
+            // face's neighbours is across the edge.
+            struct CavityEdge
+            {
+                std::uint32_t a;
+                std::uint32_t b;
+                std::uint32_t outer;
+                std::uint32_t outerSlot;
+            };
+
+            std::uint32_t InsertVertex(std::uint32_t vertex,
+                                       UrquhartChange *change);
+            void RemoveVertex(std::uint32_t vertex, UrquhartChange *change);
+            std::uint32_t NewFace();
+            void Link(std::uint32_t face, unsigned int slot,
+                      std::uint32_t neighbour, unsigned int neighbourSlot);
+
+            // Whether the edge opposite a face's slot'th vertex is in the
+            // Urquhart graph, and the graph's edges among a set of faces.
+            bool IsUrquhartEdge(std::uint32_t face, unsigned int slot) const;
+            bool IsLongestEdge(std::uint32_t face, unsigned int slot) const;
+            void UrquhartEdges(const std::vector<std::uint32_t> &faces,
+                               std::vector<IndexedEdge>         *edges) const;
+
+            std::vector<Vec2f>         m_vertices;
+            std::vector<Face>          m_faces;
+            std::vector<std::uint32_t> m_freeFaces;
+            std::uint32_t              m_lastFace;
+
+            // A face around each vertex, or NONE for a vertex that is not
+            // in the triangulation.
+            std::vector<std::uint32_t> m_vertexFaces;
+
+            // Scratch space for changes, kept to avoid allocating per point.
+            std::vector<std::uint32_t> m_faceMarks;
+            std::uint32_t              m_mark;
+            std::vector<std::uint32_t> m_cavity;
+            std::vector<CavityEdge>    m_cavityEdges;
+            std::vector<IndexedEdge>   m_urquhartBefore;
+            std::vector<IndexedEdge>   m_urquhartAfter;
     };
 
 
@@ -155,6 +414,43 @@ namespace graph {
     std::vector<Triangle> generateDelaunay(std::vector<Vec2f> &vertices);
 
 
+    /*
+     * GraphType
+     *
+     * The graphs that can be derived from a triangulation. Leaving aside
+     * ties in length and a spanning tree's extra edges, each is a subgraph
+     * of the one before it:
+     *
+     *   GABRIEL                 Edges whose diametral circle is empty.
+     *   URQUHART                The Delaunay edges less the longest edge of
+     *                           each triangle.
+     *   RELATIVE_NEIGHBOURHOOD  Edges with no point closer to both ends
+     *                           than they are to each other.
+     *   SPANNING_TREE           The Euclidean minimum spanning tree, plus
+     *                           a number of the shortest remaining Delaunay
+     *                           edges to make loops.
+     */
+    enum GraphType {
+        GABRIEL,
+        URQUHART,
+        RELATIVE_NEIGHBOURHOOD,
+        SPANNING_TREE
+    };
+
+
+    /*
+     * generateGraph
+     *
+     * Derive a graph of the points of a triangulation from its edges.
+     * extraEdges is the number of edges to add to a spanning tree. The
+     * spanning tree sorts the edges by length; the other graphs take time
+     * linear in the number of edges for evenly spread points.
+     */
+    std::vector<IndexedEdge> generateGraph(const Triangulation &tri,
+                                           GraphType            type,
+                                           unsigned int         extraEdges = 0);
+
+
     /*
      * generateUrquhart
      *
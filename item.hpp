@@ -2,6 +2,7 @@
 #define __ITEM_HPP__
 
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -14,7 +15,60 @@ namespace dungeon
             virtual ~Item() {};
     };
 
-    using ItemVector = std::vector<std::shared_ptr<Item>>;
+    // Items are owned by the arena of the level they were created on, and
+    // passed around by plain pointer.
+    using ItemHandle = Item *;
+    using ItemVector = std::vector<ItemHandle>;
+
+
+    /*
+     * ItemArena
+     *
+     * Owns the items of a level. Items are constructed in blocks and never
+     * freed one at a time, so handles stay valid for as long as the arena
+     * lives and releasing the arena frees every item at once. Given the
+     * number of items up front, the arena allocates a single block.
+     */
+    class ItemArena
+    {
+        public:
+            explicit ItemArena(std::size_t capacity = 0)
+                : m_size(0), m_blockSize(0), m_blockUsed(0)
+            {
+                if (capacity > 0) {
+                    AddBlock(capacity);
+                }
+            }
+
+            ItemArena(const ItemArena &) = delete;
+            ItemArena & operator=(const ItemArena &) = delete;
+
+            ItemHandle Create()
+            {
+                if (m_blockUsed == m_blockSize) {
+                    AddBlock(std::max<std::size_t>(m_size, 16));
+                }
+
+                m_size++;
+                return &m_blocks.back()[m_blockUsed++];
+            }
+
+            std::size_t Size() const { return m_size; }
+            std::size_t Blocks() const { return m_blocks.size(); }
+
+        private:
+            void AddBlock(std::size_t size)
+            {
+                m_blocks.emplace_back(new Item[size]);
+                m_blockSize = size;
+                m_blockUsed = 0;
+            }
+
+            std::vector<std::unique_ptr<Item[]>> m_blocks;
+            std::size_t                          m_size;
+            std::size_t                          m_blockSize;
+            std::size_t                          m_blockUsed;
+    };
 }
 
 
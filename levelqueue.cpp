@@ -0,0 +1,84 @@
+#include "levelqueue.hpp"
+
+
+namespace dungeon
+{
+    LevelQueue::LevelQueue(const GeneratorParams &params,
+                           unsigned int           seed,
+                           std::size_t            capacity)
+        : m_params(params), m_seed(seed), m_nextLevel(0),
+          m_capacity(capacity > 0 ? capacity : 1), m_stop(false)
+    {
+        // The queue is generating while the game runs, so it must not write
+        // to the log or borrow a pool that the caller may be using.
+        m_params.log = NULL;
+        m_params.pathPool = NULL;
+        m_params.visibilityPool = NULL;
+
+        m_thread = std::thread(&LevelQueue::Work, this);
+    }
+
+
+    LevelQueue::~LevelQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+
+        // A level being generated is finished before the thread stops.
+        m_thread.join();
+    }
+
+
+    std::future<std::shared_ptr<Map>> LevelQueue::Next()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        // The worker queues a level as soon as there is room, so this only
+        // waits when the queue has just been created.
+        m_cond.wait(lock, [this] { return !m_levels.empty(); });
+
+        std::future<std::shared_ptr<Map>> level = std::move(m_levels.front());
+        m_levels.pop_front();
+        lock.unlock();
+
+        m_cond.notify_all();
+        return level;
+    }
+
+
+    void LevelQueue::Work()
+    {
+        for (;;) {
+            std::promise<std::shared_ptr<Map>> promise;
+            unsigned int                       level;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this] {
+                    return m_stop || m_levels.size() < m_capacity;
+                });
+
+                if (m_stop) {
+                    return;
+                }
+
+                // Queue the level before generating it, so that a caller
+                // waiting on Next() can take it and wait on the future.
+                m_levels.push_back(promise.get_future());
+                level = m_nextLevel++;
+            }
+            m_cond.notify_all();
+
+            try {
+                Generator generator(m_params, DeriveSeed(m_seed, level));
+                generator.Run();
+                promise.set_value(generator.GetMap());
+            } catch (...) {
+                promise.set_exception(std::current_exception());
+            }
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef __LEVELQUEUE_HPP__
+#define __LEVELQUEUE_HPP__
+
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "generator.hpp"
+#include "map.hpp"
+
+
+namespace dungeon
+{
+    /*
+     * LevelQueue
+     *
+     * Generates levels ahead of time on a background thread, so that moving
+     * to the next level doesn't have to wait for the generator. Up to
+     * capacity levels are kept ready or in progress at any time. Level i of
+     * the queue is generated from DeriveSeed(seed, i), so the sequence of
+     * levels depends only on the seed and params.
+     */
+    class LevelQueue
+    {
+        public:
+            LevelQueue(const GeneratorParams &params,
+                       unsigned int           seed,
+                       std::size_t            capacity = 2);
+            ~LevelQueue();
+
+            LevelQueue(const LevelQueue &) = delete;
+            LevelQueue & operator = (const LevelQueue &) = delete;
+
+            // Take the next level from the queue. The future is usually
+            // ready already; if not, it becomes ready as soon as the
+            // background thread finishes the level. Errors from the
+            // generator are rethrown from the future's get().
+            std::future<std::shared_ptr<Map>> Next();
+
+        private:
+            void Work();
+
+            GeneratorParams                                m_params;
+            unsigned int                                   m_seed;
+            unsigned int                                   m_nextLevel;
+            std::size_t                                    m_capacity;
+            bool                                           m_stop;
+            std::deque<std::future<std::shared_ptr<Map>>>  m_levels;
+            std::mutex                                     m_mutex;
+            std::condition_variable                        m_cond;
+            std::thread                                    m_thread;
+    };
+}
+
+
+#endif // __LEVELQUEUE_HPP__
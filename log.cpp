@@ -0,0 +1,175 @@
+#include <iostream>
+
+#include "log.hpp"
+
+
+namespace util
+{
+    static const char * levelPrefix (LogLevel level)
+    {
+        switch (level) {
+        case LOG_WARNING:
+            return "warning: ";
+        case LOG_ERROR:
+            return "error: ";
+        default:
+            return "";
+        }
+    }
+
+
+    Logger::Logger(std::ostream &out, LogLevel level, std::size_t capacity)
+        : m_out(out), m_level(level), m_writePos(0), m_readPos(0),
+          m_stop(false)
+    {
+        std::size_t size = 1;
+        while (size < capacity) {
+            size *= 2;
+        }
+
+        // Each entry's sequence number says whose turn it is: an entry is
+        // free for the write at position p when its sequence is p, and
+        // holds a message for the read at position p when it is p + 1.
+        m_entries.reset(new Entry[size]);
+        m_mask = size - 1;
+        for (std::size_t i = 0; i < size; i++) {
+            m_entries[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        m_thread = std::thread(&Logger::DrainLoop, this);
+    }
+
+
+    Logger::~Logger()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wakeCv.notify_all();
+        m_thread.join();
+    }
+
+
+    Logger & Logger::Default()
+    {
+        static Logger logger(std::cout);
+        return logger;
+    }
+
+
+    bool Logger::TryPush(LogLevel level, std::string &message,
+                         std::size_t *pushed)
+    {
+        std::size_t pos = m_writePos.load(std::memory_order_relaxed);
+        Entry      *entry;
+
+        for (;;) {
+            entry = &m_entries[pos & m_mask];
+            std::size_t sequence =
+                entry->sequence.load(std::memory_order_acquire);
+
+            if (sequence == pos) {
+                // The entry is free - claim it, unless another writer got
+                // there first, in which case pos is updated to try again.
+                if (m_writePos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (sequence < pos) {
+                // The entry still holds a message from the last time round
+                // the buffer, so the buffer is full.
+                return false;
+            } else {
+                pos = m_writePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        entry->level = level;
+        entry->message.swap(message);
+        // Sequentially consistent, so that either this writer sees the
+        // background thread's read position reach pos, or the background
+        // thread sees this message before it sleeps.
+        entry->sequence.store(pos + 1, std::memory_order_seq_cst);
+        *pushed = pos;
+        return true;
+    }
+
+
+    void Logger::Write(LogLevel level, std::string message)
+    {
+        std::size_t pos;
+
+        // The background thread never sleeps on a full buffer, so there is
+        // nothing to wake here.
+        while (!TryPush(level, message, &pos)) {
+            std::this_thread::yield();
+        }
+
+        // Only wake the background thread when this message is the first in
+        // an empty buffer: otherwise it is awake, or another writer has woken
+        // it. Taking the lock makes sure it is either asleep, or has yet to
+        // look for this message.
+        if (m_readPos.load(std::memory_order_seq_cst) == pos) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_wakeCv.notify_one();
+        }
+    }
+
+
+    void Logger::Flush()
+    {
+        std::size_t target = m_writePos.load(std::memory_order_acquire);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_drainedCv.wait(lock, [this, target] {
+            return m_readPos.load(std::memory_order_acquire) >= target;
+        });
+    }
+
+
+    void Logger::DrainLoop()
+    {
+        std::size_t pos = 0;
+
+        for (;;) {
+            bool wrote = false;
+            for (;;) {
+                Entry       &entry = m_entries[pos & m_mask];
+                std::size_t  sequence =
+                    entry.sequence.load(std::memory_order_acquire);
+                if (sequence != pos + 1) {
+                    break;
+                }
+
+                m_out << levelPrefix(entry.level) << entry.message << '\n';
+                entry.message.clear();
+                entry.sequence.store(pos + m_mask + 1,
+                                     std::memory_order_release);
+                pos++;
+                wrote = true;
+            }
+
+            if (wrote) {
+                m_out.flush();
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_readPos.store(pos, std::memory_order_seq_cst);
+            m_drainedCv.notify_all();
+
+            if (m_stop && m_writePos.load(std::memory_order_acquire) == pos) {
+                return;
+            }
+
+            // Sleep until the next message is written. Its writer sees the
+            // read position stored above, and wakes this thread.
+            Entry &next = m_entries[pos & m_mask];
+            m_wakeCv.wait(lock, [this, &next, pos] {
+                return m_stop ||
+                       next.sequence.load(std::memory_order_seq_cst) ==
+                           pos + 1;
+            });
+        }
+    }
+}
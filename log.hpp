@@ -0,0 +1,115 @@
+#ifndef __LOG_HPP__
+#define __LOG_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+// Log statements below this level are compiled out entirely. Release builds
+// keep info and above; the debug build sets this to 0 to keep everything.
+#ifndef DUNGEON_LOG_LEVEL
+#define DUNGEON_LOG_LEVEL 1
+#endif
+
+/*
+ * UTIL_LOG
+ *
+ * Log a message built from a stream expression, such as
+ *
+ *     UTIL_LOG(log, util::LOG_DEBUG, "Moved " << room);
+ *
+ * where log is a util::Logger pointer, which may be NULL. The message is
+ * only formatted if the logger wants it, and if the level is below
+ * DUNGEON_LOG_LEVEL the statement compiles to nothing.
+ */
+#define UTIL_LOG(logger, level, message)                                      \
+    do {                                                                      \
+        if ((level) >= DUNGEON_LOG_LEVEL && (logger) != NULL &&               \
+            (logger)->Enabled(level)) {                                       \
+            std::ostringstream util_log_stream;                               \
+            util_log_stream << message;                                       \
+            (logger)->Write((level), util_log_stream.str());                  \
+        }                                                                     \
+    } while (0)
+
+namespace util {
+    enum LogLevel {
+        LOG_DEBUG,
+        LOG_INFO,
+        LOG_WARNING,
+        LOG_ERROR
+    };
+
+
+    /*
+     * Logger
+     *
+     * Writes log messages to a stream from a background thread, so that the
+     * threads logging never wait on I/O. Messages pass through a fixed size
+     * ring buffer that any number of threads can write to without taking a
+     * lock. If the buffer fills, writers wait for the background thread to
+     * make room rather than lose messages.
+     */
+    class Logger
+    {
+        public:
+            // The capacity is rounded up to a power of two.
+            explicit Logger(std::ostream &out,
+                            LogLevel      level = LOG_DEBUG,
+                            std::size_t   capacity = 1024);
+            ~Logger();
+
+            Logger(const Logger &) = delete;
+            Logger & operator = (const Logger &) = delete;
+
+            // A logger for the standard output, for the life of the program.
+            static Logger & Default();
+
+            bool Enabled(LogLevel level) const
+            {
+                return level >= m_level;
+            }
+
+            void SetLevel(LogLevel level)
+            {
+                m_level = level;
+            }
+
+            void Write(LogLevel level, std::string message);
+
+            // Wait until everything written so far has reached the stream.
+            void Flush();
+
+        private:
+            struct Entry
+            {
+                std::atomic<std::size_t> sequence;
+                LogLevel                 level;
+                std::string              message;
+            };
+
+            bool TryPush(LogLevel level, std::string &message,
+                         std::size_t *pushed);
+            void DrainLoop();
+
+            std::ostream                 &m_out;
+            std::atomic<LogLevel>         m_level;
+            std::unique_ptr<Entry[]>      m_entries;
+            std::size_t                   m_mask;
+            std::atomic<std::size_t>      m_writePos;
+            std::atomic<std::size_t>      m_readPos;
+            bool                          m_stop;
+            std::mutex                    m_mutex;
+            std::condition_variable       m_wakeCv;
+            std::condition_variable       m_drainedCv;
+            std::thread                   m_thread;
+    };
+}
+
+#endif /* __LOG_HPP__ */
@@ -2,7 +2,11 @@
 #define __MAINMENU_H__
 
 
-#include "generator.hpp"
+#include <random>
+
+#include "game.hpp"
+#include "generatorstate.hpp"
+#include "levelqueue.hpp"
 #include "menu.hpp"
 
 
@@ -12,6 +16,7 @@ namespace dungeon {
         public:
             enum {
                 ITEM_START,
+                ITEM_GENERATOR,
                 ITEM_QUIT
             };
 
@@ -24,9 +29,14 @@ namespace dungeon {
                                      { 255, 255, 255, 255 },
                                      ITEM_START)));
                 m_items.push_back(std::shared_ptr<TextMenuItem>(
-                    new TextMenuItem("Quit",
+                    new TextMenuItem("Generator",
                                      400, 400, 32,
                                      { 255, 255, 255, 255 },
+                                     ITEM_GENERATOR)));
+                m_items.push_back(std::shared_ptr<TextMenuItem>(
+                    new TextMenuItem("Quit",
+                                     400, 450, 32,
+                                     { 255, 255, 255, 255 },
                                      ITEM_QUIT)));
             }
 
@@ -34,6 +44,20 @@ namespace dungeon {
             {
                 switch (id) {
                 case ITEM_START:
+                {
+                    // Levels are generated in the background, so only the
+                    // first one has to be waited for.
+                    auto levels = std::make_shared<LevelQueue>(
+                                        Game::LevelParams(),
+                                        std::random_device{}());
+                    m_manager.Push(std::make_shared<Game>(
+                                        nullptr, m_manager,
+                                        levels->Next().get(), levels));
+                    break;
+                }
+
+                case ITEM_GENERATOR:
+                    // Step through the generation of a level, then play it.
                     m_manager.Push(std::make_shared<GeneratorGameState>(m_manager));
                     break;
 
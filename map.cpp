@@ -1,6 +1,156 @@
+#include <cstring>
+#include <stdexcept>
 #include "map.hpp"
 namespace dungeon
 {
+    const unsigned int  Map::MAX_VISIBILITY_RADIUS;
+    const std::uint32_t Map::NO_VISIBILITY_SET;
+
+
+
+    /*
+     * allocateWords
+     *
+     * Allocate a zeroed block of 64 bit words.
+     */
+    static std::shared_ptr<void> allocateWords (std::size_t words)
+    {
+        return std::shared_ptr<void>(
+                    new std::uint64_t[words](),
+                    [](void *storage) {
+                        delete[] static_cast<std::uint64_t *>(storage);
+                    });
+    }
+
+
+    /*
+     * allocateStorage
+     *
+     * Allocate a zeroed storage block for the planes of a map.
+     */
+    static std::shared_ptr<void> allocateStorage (std::size_t tiles)
+    {
+        return allocateWords(Map::StorageWords(tiles));
+    }
+
+
+    Map::Map(unsigned int width, unsigned int height)
+        : m_width(width), m_height(height),
+          m_tileCount(static_cast<std::size_t>(width) * height),
+          m_types(NULL), m_blockerRowWords(0), m_blockerColumnWords(0),
+          m_blockersFound(false), m_visibleListed(true), m_viewValid(false),
+          m_viewX(0), m_viewY(0), m_viewRadius(0), m_staleOctants(0),
+          m_visibilityRadius(0), m_visibilitySlots(NULL),
+          m_visibilitySets(NULL), m_visibilityWords(0)
+    {
+        BindPlanes(allocateStorage(m_tileCount));
+        Clear();
+    }
+
+
+    Map::Map(const Map &other)
+        : m_width(0), m_height(0), m_tileCount(0), m_types(NULL),
+          m_blockerRowWords(0), m_blockerColumnWords(0),
+          m_blockersFound(false), m_visibleListed(true), m_viewValid(false),
+          m_viewX(0), m_viewY(0), m_viewRadius(0), m_staleOctants(0),
+          m_visibilityRadius(0), m_visibilitySlots(NULL),
+          m_visibilitySets(NULL), m_visibilityWords(0)
+    {
+        *this = other;
+    }
+
+
+    Map & Map::operator=(const Map &other)
+    {
+        if (this != &other) {
+            // Copies always get storage of their own, so a map loaded from a
+            // file can be copied and changed without affecting the original.
+            m_width = other.m_width;
+            m_height = other.m_height;
+            m_tileCount = other.m_tileCount;
+            BindPlanes(allocateStorage(m_tileCount));
+            std::memcpy(m_storage.get(), other.m_storage.get(),
+                        StorageWords(m_tileCount) * sizeof(std::uint64_t));
+
+            m_items = other.m_items;
+            m_itemArena = other.m_itemArena;
+            m_rooms = other.m_rooms;
+            m_roomEdges = other.m_roomEdges;
+
+            if (other.m_blockersFound) {
+                std::lock_guard<std::mutex> lock(other.m_blockersMutex);
+                m_blockerRows = other.m_blockerRows;
+                m_blockerRowWords = other.m_blockerRowWords;
+                m_blockerColumns = other.m_blockerColumns;
+                m_blockerColumnWords = other.m_blockerColumnWords;
+            }
+            m_blockersFound = other.m_blockersFound.load();
+
+            m_visibleTiles = other.m_visibleTiles;
+            m_visibleListed = other.m_visibleListed;
+            m_viewValid = other.m_viewValid;
+            m_viewX = other.m_viewX;
+            m_viewY = other.m_viewY;
+            m_viewRadius = other.m_viewRadius;
+            m_viewCorners = other.m_viewCorners;
+            m_staleOctants = other.m_staleOctants;
+
+            // The visibility sets never change once built, so are shared,
+            // but each map has its own doors.
+            m_visibilityRadius = other.m_visibilityRadius;
+            m_visibilityStorage = other.m_visibilityStorage;
+            m_visibilitySlots = other.m_visibilitySlots;
+            m_visibilitySets = other.m_visibilitySets;
+            m_visibilityWords = other.m_visibilityWords;
+            m_visibilityDisc = other.m_visibilityDisc;
+            m_doors = other.m_doors;
+            m_closedDoors = other.m_closedDoors;
+        }
+
+        return *this;
+    }
+
+
+    void Map::BindPlanes(std::shared_ptr<void> storage)
+    {
+        std::uint64_t *words = static_cast<std::uint64_t *>(storage.get());
+        std::size_t    plane_words = BitPlane::Words(m_tileCount);
+
+        m_storage = storage;
+        m_types = reinterpret_cast<std::uint8_t *>(words);
+        words += (m_tileCount + 7) / 8;
+        m_spawn = BitPlane(words, plane_words);
+        words += plane_words;
+        m_visible = BitPlane(words, plane_words);
+        words += plane_words;
+        m_seen = BitPlane(words, plane_words);
+    }
+
+
+    void Map::FindBlockers() const
+    {
+        std::lock_guard<std::mutex> lock(m_blockersMutex);
+        if (m_blockersFound) {
+            return;
+        }
+
+        m_blockerRowWords = BitPlane::Words(m_width + 2);
+        m_blockerColumnWords = BitPlane::Words(m_height + 2);
+        m_blockerRows.assign((m_height + 2) * m_blockerRowWords,
+                             ~std::uint64_t(0));
+        m_blockerColumns.assign((m_width + 2) * m_blockerColumnWords,
+                                ~std::uint64_t(0));
+
+        for (unsigned int y = 0; y < m_height; y++) {
+            for (unsigned int x = 0; x < m_width; x++) {
+                SetBlocker(x, y, BlocksVisibility(x, y));
+            }
+        }
+
+        m_blockersFound = true;
+    }
+
+
     static int sign (int val)
     {
         if (val > 0) {
@@ -16,39 +166,39 @@ namespace dungeon
     bool Map::CheckCornerVisibility(unsigned int cornerx, unsigned int cornery,
                                     int signx, int signy) const
     {
-        if (GetTile(cornerx, cornery).BlocksVisibility()) {
-            if (GetTile(cornerx - 1, cornery).BlocksVisibility()) {
+        if (BlocksVisibility(cornerx, cornery)) {
+            if (BlocksVisibility(cornerx - 1, cornery)) {
                 return false;
             }
-            if (GetTile(cornerx, cornery - 1).BlocksVisibility()) {
+            if (BlocksVisibility(cornerx, cornery - 1)) {
                 return false;
             }
         }
 
-        if (GetTile(cornerx - 1, cornery - 1).BlocksVisibility()) {
-            if (GetTile(cornerx, cornery - 1).BlocksVisibility()) {
+        if (BlocksVisibility(cornerx - 1, cornery - 1)) {
+            if (BlocksVisibility(cornerx, cornery - 1)) {
                 return false;
             }
-            if (GetTile(cornerx - 1, cornery).BlocksVisibility()) {
+            if (BlocksVisibility(cornerx - 1, cornery)) {
                 return false;
             }
         }
 
         if (signx * signy == 1) {
-            if (GetTile(cornerx, cornery).BlocksVisibility() ||
-                GetTile(cornerx - 1, cornery - 1).BlocksVisibility()) {
+            if (BlocksVisibility(cornerx, cornery) ||
+                BlocksVisibility(cornerx - 1, cornery - 1)) {
                 return false;
             }
         } else if (signx * signy == -1) {
-            if (GetTile(cornerx - 1, cornery).BlocksVisibility() ||
-                GetTile(cornerx, cornery - 1).BlocksVisibility()) {
+            if (BlocksVisibility(cornerx - 1, cornery) ||
+                BlocksVisibility(cornerx, cornery - 1)) {
                 return false;
             }
         } else {
-            if (GetTile(cornerx - 1, cornery - 1).BlocksVisibility() ||
-                GetTile(cornerx - 1, cornery).BlocksVisibility() ||
-                GetTile(cornerx, cornery - 1).BlocksVisibility() ||
-                GetTile(cornerx, cornery).BlocksVisibility()) {
+            if (BlocksVisibility(cornerx - 1, cornery - 1) ||
+                BlocksVisibility(cornerx - 1, cornery) ||
+                BlocksVisibility(cornerx, cornery - 1) ||
+                BlocksVisibility(cornerx, cornery)) {
                 return false;
             }
         }
@@ -64,39 +214,39 @@ namespace dungeon
 
         // Check whether the immediate neighbour in the given direction blocks.
         if (signx == 0 && signy == -1 &&
-            GetTile(startx, starty - 1).BlocksVisibility() &&
-            GetTile(startx - 1, starty - 1).BlocksVisibility()) {
+            BlocksVisibility(startx, starty - 1) &&
+            BlocksVisibility(startx - 1, starty - 1)) {
             return false;
         }
         if (signx == -1 && signy == 0 &&
-            GetTile(startx - 1, starty).BlocksVisibility() &&
-            GetTile(startx - 1, starty - 1).BlocksVisibility()) {
+            BlocksVisibility(startx - 1, starty) &&
+            BlocksVisibility(startx - 1, starty - 1)) {
             return false;
         }
         if (signx == 0 && signy == 1 &&
-            GetTile(startx, starty).BlocksVisibility() &&
-            GetTile(startx - 1, starty).BlocksVisibility()) {
+            BlocksVisibility(startx, starty) &&
+            BlocksVisibility(startx - 1, starty)) {
             return false;
         }
         if (signx == 1 && signy == 0 &&
-            GetTile(startx, starty).BlocksVisibility() &&
-            GetTile(startx, starty - 1).BlocksVisibility()) {
+            BlocksVisibility(startx, starty) &&
+            BlocksVisibility(startx, starty - 1)) {
             return false;
         }
         if (signx == 1 && signy == 1 &&
-            GetTile(startx, starty).BlocksVisibility()) {
+            BlocksVisibility(startx, starty)) {
             return false;
         }
         if (signx == -1 && signy == 1 &&
-            GetTile(startx - 1, starty).BlocksVisibility()) {
+            BlocksVisibility(startx - 1, starty)) {
             return false;
         }
         if (signx == -1 && signy == -1 &&
-            GetTile(startx - 1, starty - 1).BlocksVisibility()) {
+            BlocksVisibility(startx - 1, starty - 1)) {
             return false;
         }
         if (signx == 1 && signy == -1 &&
-            GetTile(startx, starty - 1).BlocksVisibility()) {
+            BlocksVisibility(startx, starty - 1)) {
             return false;
         }
 
@@ -129,8 +279,8 @@ namespace dungeon
                     // Check for a wall between this tile and the tile to the
                     // left (i.e. if either this tile or the tile to the left
                     // blocks vis).
-                    if (GetTile(cellx, celly).BlocksVisibility() ||
-                        GetTile(cellx - 1, celly).BlocksVisibility()) {
+                    if (BlocksVisibility(cellx, celly) ||
+                        BlocksVisibility(cellx - 1, celly)) {
                         return false;
                     }
                 } else {
@@ -160,8 +310,8 @@ namespace dungeon
                     // Check for a wall between this tile and the tile above it
                     // (i.e. if either this tile or the tile above it blocks
                     // vis).
-                    if (GetTile(cellx, celly).BlocksVisibility() ||
-                        GetTile(cellx, celly - 1).BlocksVisibility()) {
+                    if (BlocksVisibility(cellx, celly) ||
+                        BlocksVisibility(cellx, celly - 1)) {
                         return false;
                     }
                 } else {
@@ -177,8 +327,8 @@ namespace dungeon
         return true;
     }
 
-    bool Map::IsVisible (unsigned int startx, unsigned int starty,
-                         unsigned int endx, unsigned int endy) const
+    bool Map::IsVisibleTraced(unsigned int startx, unsigned int starty,
+                              unsigned int endx, unsigned int endy) const
     {
         unsigned int corners[4][2] = {
             { 0, 0 }, // Top left
@@ -203,52 +353,1250 @@ namespace dungeon
     }
 
 
-    std::vector<Tile *> Map::GetTileNeighbours (Tile *tile, bool diags)
+    /*
+     * spanBlocked
+     *
+     * Whether any of the tiles from first to last of a row (or column) of a
+     * blocker board block sight.
+     */
+    static bool spanBlocked(const std::uint64_t *line, int first, int last)
+    {
+        std::size_t   low = static_cast<std::size_t>(first + 1);
+        std::size_t   high = static_cast<std::size_t>(last + 1);
+        std::uint64_t low_mask = ~std::uint64_t(0) << (low % 64);
+        std::uint64_t high_mask = ~std::uint64_t(0) >> (63 - high % 64);
+
+        if (low / 64 == high / 64) {
+            return (line[low / 64] & low_mask & high_mask) != 0;
+        }
+
+        if ((line[low / 64] & low_mask) != 0) {
+            return true;
+        }
+        for (std::size_t word = low / 64 + 1; word < high / 64; word++) {
+            if (line[word] != 0) {
+                return true;
+            }
+        }
+        return (line[high / 64] & high_mask) != 0;
+    }
+
+
+    /*
+     * spanFull
+     *
+     * Whether all of the tiles from first to last of a row (or column) of a
+     * blocker board block sight.
+     */
+    static bool spanFull(const std::uint64_t *line, int first, int last)
+    {
+        std::size_t   low = static_cast<std::size_t>(first + 1);
+        std::size_t   high = static_cast<std::size_t>(last + 1);
+        std::uint64_t low_mask = ~std::uint64_t(0) << (low % 64);
+        std::uint64_t high_mask = ~std::uint64_t(0) >> (63 - high % 64);
+
+        if (low / 64 == high / 64) {
+            return (~line[low / 64] & low_mask & high_mask) == 0;
+        }
+
+        if ((~line[low / 64] & low_mask) != 0) {
+            return false;
+        }
+        for (std::size_t word = low / 64 + 1; word < high / 64; word++) {
+            if (~line[word] != 0) {
+                return false;
+            }
+        }
+        return (~line[high / 64] & high_mask) == 0;
+    }
+
+
+    static int floorDiv (int num, int den)
+    {
+        return num >= 0 ? num / den : -((-num + den - 1) / den);
+    }
+
+
+    /*
+     * wallBetween
+     *
+     * Whether a line of a blocker board between the tiles at (a0, b0) and
+     * (a1, b1) is blocked all the way across the hull of the two tiles,
+     * cutting off every ray between them. Lines next to either tile are
+     * skipped, as a ray of a single step along a grid line can slip between
+     * the tiles of one.
+     */
+    static bool wallBetween(const std::uint64_t *board, std::size_t stride,
+                            int a0, int b0, int a1, int b1)
+    {
+        if (b0 > b1) {
+            std::swap(a0, a1);
+            std::swap(b0, b1);
+        }
+
+        int da = a1 - a0;
+        int db = b1 - b0;
+        for (int b = b0 + 2; b < b1 - 1; b++) {
+            // The hull on line b is the start tile moved along by anything
+            // from (b - b0 - 1) / db to (b - b0 + 1) / db of the way.
+            int low = da >= 0 ? b - b0 - 1 : b - b0 + 1;
+            int high = da >= 0 ? b - b0 + 1 : b - b0 - 1;
+            int first = a0 + floorDiv(low * da, db);
+            int last = a0 - floorDiv(-high * da, db);
+            if (spanFull(board + (b + 1) * stride, first, last)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    /*
+     * lineBlocked
+     *
+     * Whether a ray between two tile corners is blocked, on a blocker board
+     * whose lines run along the ray's major axis: a is the position along a
+     * line and b the line, and the ray moves at least as far in a as in b.
+     * The tiles the ray passes through on each line it crosses are a single
+     * span, tested at once. The lines are tested from (a0, b0) on.
+     */
+    static bool lineBlocked(const std::uint64_t *board, std::size_t stride,
+                            int a0, int b0, int a1, int b1)
     {
-        std::vector<Tile *> neighbours;
+        int da = std::abs(a1 - a0);
+        int db = std::abs(b1 - b0);
+        if (da == 0) {
+            return false;
+        }
 
-        if (tile->x > 0) {
-            neighbours.push_back(
-                &m_tiles[CoordsToTileIndex(tile->x - 1, tile->y)]);
+        if (db == 0) {
+            // Along a grid line, between the lines b0 - 1 and b0. A single
+            // step only passes between the tiles either side of it, so is
+            // only blocked if both are.
+            int  first = std::min(a0, a1);
+            bool before = spanBlocked(board + b0 * stride, first,
+                                      first + da - 1);
+            bool after = spanBlocked(board + (b0 + 1) * stride, first,
+                                     first + da - 1);
+            return da == 1 ? before && after : before || after;
         }
 
-        if (tile->x < MAP_WIDTH - 1) {
-            neighbours.push_back(
-                &m_tiles[CoordsToTileIndex(tile->x + 1, tile->y)]);
+        // On its kth line the ray runs from k * da / db to (k + 1) * da / db
+        // along from a0, so passes through the tiles from the floor of one
+        // to the ceiling of the other, less one. The quotient and remainder
+        // are kept as the ray goes.
+        int                  step = da / db;
+        int                  step_rem = da % db;
+        int                  quot = 0;
+        int                  rem = 0;
+        const std::uint64_t *line;
+        std::ptrdiff_t       line_step;
+
+        if (b1 > b0) {
+            line = board + (b0 + 1) * stride;
+            line_step = static_cast<std::ptrdiff_t>(stride);
+        } else {
+            line = board + b0 * stride;
+            line_step = -static_cast<std::ptrdiff_t>(stride);
         }
 
-        if (tile->y > 0) {
-            neighbours.push_back(
-                &m_tiles[CoordsToTileIndex(tile->x, tile->y - 1)]);
+        for (int k = 0; k < db; k++) {
+            int low = quot;
+
+            quot += step;
+            rem += step_rem;
+            if (rem >= db) {
+                rem -= db;
+                quot++;
+            }
+
+            int high = quot + (rem != 0 ? 1 : 0) - 1;
+            if (a1 > a0 ? spanBlocked(line, a0 + low, a0 + high) :
+                          spanBlocked(line, a0 - high - 1, a0 - low - 1)) {
+                return true;
+            }
+            line += line_step;
         }
 
-        if (tile->y < MAP_HEIGHT - 1) {
-            neighbours.push_back(
-                &m_tiles[CoordsToTileIndex(tile->x, tile->y + 1)]);
+        return false;
+    }
+
+
+    bool Map::RayBlocked(int startx, int starty, int endx, int endy) const
+    {
+        // Most rays are blocked by the first or last tile they pass through,
+        // so those are tested on their own first, then the lines from the
+        // far end back.
+        if (endx != startx && endy != starty) {
+            int firstx = endx > startx ? startx : startx - 1;
+            int firsty = endy > starty ? starty : starty - 1;
+            int lastx = endx > startx ? endx - 1 : endx;
+            int lasty = endy > starty ? endy - 1 : endy;
+            if (IsBlocker(firstx, firsty) || IsBlocker(lastx, lasty)) {
+                return true;
+            }
+        }
+
+        if (std::abs(endx - startx) >= std::abs(endy - starty)) {
+            return lineBlocked(m_blockerRows.data(), m_blockerRowWords,
+                               endx, endy, startx, starty);
+        } else {
+            return lineBlocked(m_blockerColumns.data(), m_blockerColumnWords,
+                               endy, endx, starty, startx);
+        }
+    }
+
+
+    bool Map::IsVisible (unsigned int startx, unsigned int starty,
+                         unsigned int endx, unsigned int endy) const
+    {
+        if (!m_blockersFound.load(std::memory_order_acquire)) {
+            FindBlockers();
+        }
+
+        int x0 = static_cast<int>(startx);
+        int y0 = static_cast<int>(starty);
+        int x1 = static_cast<int>(endx);
+        int y1 = static_cast<int>(endy);
+
+        for (unsigned int ray = 0; ray < 16; ray++) {
+            // Most tiles in sight are seen along the first ray. Failing
+            // that, a wall right across the way between the tiles cuts off
+            // all the rays at once.
+            if (ray == 1 &&
+                (wallBetween(m_blockerRows.data(), m_blockerRowWords,
+                             x0, y0, x1, y1) ||
+                 wallBetween(m_blockerColumns.data(), m_blockerColumnWords,
+                             y0, x0, y1, x1))) {
+                return false;
+            }
+
+            unsigned int from = ray / 4;
+            unsigned int to = ray % 4;
+            if (!RayBlocked(x0 + static_cast<int>(from & 1),
+                            y0 + static_cast<int>(from >> 1),
+                            x1 + static_cast<int>(to & 1),
+                            y1 + static_cast<int>(to >> 1))) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    /*
+     * Slope
+     *
+     * The slope of a line from a corner, as an exact fraction with a
+     * denominator that is never negative. A zero denominator is an infinite
+     * slope.
+     */
+    struct Slope
+    {
+        int num;
+        int den;
+    };
+
+
+    static inline bool operator < (const Slope &a, const Slope &b)
+    {
+        return a.num * b.den < b.num * a.den;
+    }
+
+
+    /*
+     * The octants around a corner: the corner (i, j) of an octant, with
+     * 0 <= j <= i, is at (i * xx + j * xy, i * yx + j * yy) from it. The
+     * lines along the axes are cast with the first octant that runs along
+     * each.
+     */
+    struct Octant
+    {
+        int  xx;
+        int  xy;
+        int  yx;
+        int  yy;
+        bool axis;
+    };
+
+    static const Octant OCTANTS[8] = {
+        {  1,  0,  0,  1, true  }, {  1,  0,  0, -1, false },
+        { -1,  0,  0,  1, true  }, { -1,  0,  0, -1, false },
+        {  0,  1,  1,  0, true  }, {  0,  1, -1,  0, true  },
+        {  0, -1,  1,  0, false }, {  0, -1, -1,  0, false },
+    };
+
+    static const unsigned int ALL_OCTANTS = 0xff;
+
+
+    /*
+     * ShadowCaster
+     *
+     * Finds the tile corners that can be seen from a corner, up to a reach
+     * of columns out, marking them in a square window of corners with a bit
+     * for each octant they were seen in. IsVisible has a line from one
+     * corner to another blocked when it passes through a blocking tile, or
+     * runs along the edge of one, unless that edge is the whole line and
+     * the tile on the other side is open.
+     *
+     * Each octant around the corner is shadowcast: working out a column at
+     * a time, the blocking tiles in a column shade the slopes through their
+     * insides, and the corners on the next column line at slopes still lit
+     * are seen. Slopes are kept exact, so that lines grazing a tile, or
+     * squeezing diagonally between two, come out as in IsVisible. Lines
+     * along the axes are walked separately.
+     */
+    class ShadowCaster
+    {
+        public:
+            ShadowCaster(const Map &map, int left, int top, int size,
+                         int reach, bool doorsOpen, std::uint8_t *corners)
+                : m_map(map), m_left(left), m_top(top), m_size(size),
+                  m_reach(reach), m_doorsOpen(doorsOpen), m_corners(corners)
+            {
+            }
+
+            // Cast the octants given as a mask of bits.
+            void Cast(int originx, int originy, unsigned int octants)
+            {
+                m_originX = originx;
+                m_originY = originy;
+
+                Slope low = { 0, 1 };
+                Slope high = { 1, 1 };
+                for (unsigned int i = 0; i < 8; i++) {
+                    if ((octants & (1 << i)) == 0) {
+                        continue;
+                    }
+
+                    m_octant = OCTANTS[i];
+                    m_bit = static_cast<std::uint8_t>(1 << i);
+                    See(originx, originy);
+                    if (m_octant.axis) {
+                        CastAxis(m_octant.xx, m_octant.yx);
+                    }
+                    Scan(1, low, high);
+                }
+            }
+
+        private:
+            // Whether the tile at (x, y) blocks visibility, counting the
+            // tiles off the map as blocking.
+            bool Blocks(int x, int y) const
+            {
+                if (x < 0 || y < 0 || x >= static_cast<int>(m_map.Width()) ||
+                    y >= static_cast<int>(m_map.Height())) {
+                    return true;
+                }
+
+                Tile::TileType type = m_map.GetType(x, y);
+                return Tile::BlocksVisibility(type) &&
+                       !(m_doorsOpen && type == Tile::DOOR_CLOSED);
+            }
+
+            void See(int x, int y)
+            {
+                if (x >= m_left && y >= m_top && x < m_left + m_size &&
+                    y < m_top + m_size) {
+                    m_corners[(y - m_top) * m_size + (x - m_left)] |= m_bit;
+                }
+            }
+
+            void CastAxis(int dx, int dy)
+            {
+                bool open = true;
+                for (int length = 1; length <= m_reach; length++) {
+                    // The tiles either side of the line's last step.
+                    int step = dx + dy > 0 ? length - 1 : -length;
+                    int x = m_originX + step * dx * dx;
+                    int y = m_originY + step * dy * dy;
+                    bool side1 = Blocks(x, y);
+                    bool side2 = dx != 0 ? Blocks(x, y - 1) : Blocks(x - 1, y);
+
+                    open = open && !side1 && !side2;
+                    if (length == 1 ? side1 && side2 : !open) {
+                        return;
+                    }
+                    See(m_originX + length * dx, m_originY + length * dy);
+                }
+            }
+
+            // Shade the slopes from low to high, which are lit up to the
+            // column line i - 1, with the blocking tiles between the lines
+            // i - 1 and i. Tile k of the column spans the slopes from k / i
+            // to (k + 1) / (i - 1).
+            void Scan(int i, Slope low, Slope high)
+            {
+                const Octant &o = m_octant;
+                int           first = std::max(low.num * (i - 1) / low.den - 1,
+                                               0);
+                int           last = std::min(
+                                        (high.num * i + high.den - 1) /
+                                        high.den, i - 1);
+                Slope         lit = low;
+
+                for (int k = first; k <= last && !(high < lit); k++) {
+                    int cornerx1 = m_originX + (i - 1) * o.xx + k * o.xy;
+                    int cornery1 = m_originY + (i - 1) * o.yx + k * o.yy;
+                    int cornerx2 = m_originX + i * o.xx + (k + 1) * o.xy;
+                    int cornery2 = m_originY + i * o.yx + (k + 1) * o.yy;
+                    if (!Blocks(std::min(cornerx1, cornerx2),
+                                std::min(cornery1, cornery2))) {
+                        continue;
+                    }
+
+                    // The slopes through the tile are shaded, but not those
+                    // only touching its corners.
+                    Slope start = { k, i };
+                    Slope end = { k + 1, i - 1 };
+                    if (!(start < lit)) {
+                        Light(i, lit, high < start ? high : start);
+                    }
+                    if (lit < end) {
+                        lit = end;
+                    }
+                }
+
+                if (!(high < lit)) {
+                    Light(i, lit, high);
+                }
+            }
+
+            // See the corners on column line i at slopes from low to high,
+            // and carry on to the next column.
+            void Light(int i, Slope low, Slope high)
+            {
+                const Octant &o = m_octant;
+                int first = std::max((low.num * i + low.den - 1) / low.den, 1);
+                int last = std::min(high.num * i / high.den, i);
+                for (int j = first; j <= last; j++) {
+                    See(m_originX + i * o.xx + j * o.xy,
+                        m_originY + i * o.yx + j * o.yy);
+                }
+
+                if (i < m_reach) {
+                    Scan(i + 1, low, high);
+                }
+            }
+
+            const Map    &m_map;
+            int           m_left;
+            int           m_top;
+            int           m_size;
+            int           m_reach;
+            bool          m_doorsOpen;
+            std::uint8_t *m_corners;
+            int           m_originX;
+            int           m_originY;
+            Octant        m_octant;
+            std::uint8_t  m_bit;
+    };
+
+
+    /*
+     * castView
+     *
+     * Cast some octants of the view from each corner of the tile at (x, y),
+     * into a window of corners (2 * radius + 2) wide, with (x - radius,
+     * y - radius) at its top left. Closed doors can be taken as open.
+     */
+    static void castView(const Map &map, unsigned int x, unsigned int y,
+                         unsigned int radius, bool doorsOpen,
+                         std::uint8_t *corners, unsigned int octants)
+    {
+        int          r = static_cast<int>(radius);
+        ShadowCaster caster(map, static_cast<int>(x) - r,
+                            static_cast<int>(y) - r, 2 * r + 2, r + 1,
+                            doorsOpen, corners);
+        for (unsigned int corner = 0; corner < 4; corner++) {
+            caster.Cast(static_cast<int>(x + (corner & 1)),
+                        static_cast<int>(y + (corner >> 1)), octants);
+        }
+    }
+
+
+    /*
+     * collectView
+     *
+     * Pass each tile within radius of (x, y) that has a corner seen in a
+     * window of corners filled by castView to visit, as its x and y.
+     */
+    template <class Visit>
+    static void collectView(const Map &map, unsigned int x, unsigned int y,
+                            unsigned int radius, const std::uint8_t *corners,
+                            Visit visit)
+    {
+        int r = static_cast<int>(radius);
+        int size = 2 * r + 2;
+        int left = std::max(static_cast<int>(x) - r, 0);
+        int top = std::max(static_cast<int>(y) - r, 0);
+        int right = std::min(static_cast<int>(x) + r,
+                             static_cast<int>(map.Width()) - 1);
+        int bottom = std::min(static_cast<int>(y) + r,
+                              static_cast<int>(map.Height()) - 1);
+
+        for (int tile_y = top; tile_y <= bottom; tile_y++) {
+            for (int tile_x = left; tile_x <= right; tile_x++) {
+                int x_dist = static_cast<int>(x) - tile_x;
+                int y_dist = static_cast<int>(y) - tile_y;
+                if (x_dist * x_dist + y_dist * y_dist > r * r) {
+                    continue;
+                }
+
+                const std::uint8_t *corner = corners + (r - y_dist) * size +
+                                             (r - x_dist);
+                if (corner[0] | corner[1] | corner[size] | corner[size + 1]) {
+                    visit(tile_x, tile_y);
+                }
+            }
+        }
+    }
+
+
+    void Map::FieldOfView(unsigned int x, unsigned int y, unsigned int radius,
+                          std::vector<std::size_t> *visible) const
+    {
+        // A tile can be seen if one of its corners can be seen from one of
+        // the corners of (x, y).
+        std::size_t               size = 2 * radius + 2;
+        std::vector<std::uint8_t> corners(size * size, 0);
+
+        castView(*this, x, y, radius, false, corners.data(), ALL_OCTANTS);
+        collectView(*this, x, y, radius, corners.data(),
+                    [this, visible](int tile_x, int tile_y) {
+                        visible->push_back(TileIndex(tile_x, tile_y));
+                    });
+    }
+
+
+    /*
+     * Visibility set layout
+     *
+     * The bytes of a set's header and of each of its door words, and the
+     * offset of each part of a door word.
+     */
+    static const std::size_t SET_HEADER_BYTES = 3;
+    static const std::size_t SET_DOOR_BYTES = 12;
+    static const std::size_t SET_DOOR_MASK = 4;
+
+
+    /*
+     * discRows
+     *
+     * The columns of each row of the sight square of a radius that are in
+     * the sight circle, as a bit for each column from the left.
+     */
+    static std::vector<std::uint64_t> discRows(unsigned int radius)
+    {
+        int                        r = static_cast<int>(radius);
+        std::vector<std::uint64_t> rows;
+
+        for (int y = -r; y <= r; y++) {
+            int half = 0;
+            while ((half + 1) * (half + 1) + y * y <= r * r) {
+                half++;
+            }
+            rows.push_back(((std::uint64_t(2) << (2 * half)) - 1) <<
+                           (r - half));
+        }
+
+        return rows;
+    }
+
+
+    /*
+     * forEachRun
+     *
+     * Pass each run of visible tiles in a visibility set to visit, as its row
+     * and starting column counted from the top left of the sight square, and
+     * its length. A group of rows shares its runs, cut down to the sight
+     * circle on each row, given by disc.
+     */
+    template <class Visit>
+    static void forEachRun(const std::uint8_t                *set,
+                           const std::vector<std::uint64_t>  &disc,
+                           Visit                              visit)
+    {
+        const std::uint8_t *group = set + SET_HEADER_BYTES +
+                                    set[0] * SET_DOOR_BYTES;
+        int                 row = set[1];
+
+        for (int i = 0; i < set[2]; i++) {
+            const std::uint8_t *end = group + 2 + 2 * group[1];
+            for (int last = row + group[0]; row < last; row++) {
+                int left = __builtin_ctzll(disc[row]);
+                int right = 64 - __builtin_clzll(disc[row]);
+                for (const std::uint8_t *run = group + 2; run < end;
+                     run += 2) {
+                    int start = std::max<int>(run[0], left);
+                    int stop = std::min<int>(run[0] + run[1], right);
+                    if (start < stop) {
+                        visit(row, start, stop - start);
+                    }
+                }
+            }
+            group = end;
+        }
+    }
+
+
+    /*
+     * checkSet
+     *
+     * Check that a visibility set of the given radius for the viewer at (x,
+     * y) lies within bytes, only names door words below door_words, and
+     * only has tiles on the map, returning its size or 0 if not.
+     */
+    static std::size_t checkSet(const std::uint8_t *set, std::size_t bytes,
+                                std::size_t door_words, int radius, int x,
+                                int y, int width, int height)
+    {
+        if (bytes < SET_HEADER_BYTES ||
+            bytes - SET_HEADER_BYTES < set[0] * SET_DOOR_BYTES ||
+            y + set[1] - radius < 0) {
+            return 0;
+        }
+
+        for (std::size_t i = 0; i < set[0]; i++) {
+            std::uint32_t word;
+            std::memcpy(&word, set + SET_HEADER_BYTES + i * SET_DOOR_BYTES,
+                        sizeof(word));
+            if (word >= door_words) {
+                return 0;
+            }
+        }
+
+        std::size_t pos = SET_HEADER_BYTES + set[0] * SET_DOOR_BYTES;
+        int         row = set[1];
+        for (int i = 0; i < set[2]; i++) {
+            if (bytes - pos < 2 || (bytes - pos - 2) / 2 < set[pos + 1]) {
+                return 0;
+            }
+
+            // The group's rows must all be in the sight square, and on the
+            // map.
+            row += set[pos];
+            if (row > 2 * radius + 1 || y + row - radius > height) {
+                return 0;
+            }
+
+            std::size_t runs = set[pos + 1];
+            for (pos += 2; runs > 0; runs--, pos += 2) {
+                int left = x + set[pos] - radius;
+                if (left < 0 || left + set[pos + 1] > width ||
+                    set[pos] + set[pos + 1] > 2 * radius + 1) {
+                    return 0;
+                }
+            }
+        }
+
+        return pos;
+    }
+
+
+    VisibilitySetBuilder::VisibilitySetBuilder(Map &map, unsigned int radius)
+        : m_map(map), m_radius(radius),
+          m_slots(map.TileCount(), Map::NO_VISIBILITY_SET)
+    {
+        if (radius == 0 || radius > Map::MAX_VISIBILITY_RADIUS) {
+            throw std::runtime_error("Visibility set radius out of range");
+        }
+        m_disc = discRows(radius);
+
+        for (std::size_t i = 0; i < map.TileCount(); i++) {
+            if (map.GetType(i) == Tile::DOOR_OPEN ||
+                map.GetType(i) == Tile::DOOR_CLOSED) {
+                m_doors.push_back(static_cast<std::uint32_t>(i));
+            }
+        }
+    }
+
+
+    void VisibilitySetBuilder::BuildSet(unsigned int                x,
+                                        unsigned int                y,
+                                        std::vector<std::uint8_t>  *corners,
+                                        std::vector<std::uint64_t> *rows,
+                                        std::vector<std::uint8_t>  *sets) const
+    {
+        int                        r = static_cast<int>(m_radius);
+        int                        left = static_cast<int>(x) - r;
+        int                        top = static_cast<int>(y) - r;
+        std::vector<std::uint32_t> doors;
+
+        std::fill(corners->begin(), corners->end(), 0);
+        std::fill(rows->begin(), rows->end(), 0);
+        castView(m_map, x, y, m_radius, true, corners->data(), ALL_OCTANTS);
+
+        // The tiles are visited in index order, so the doors seen come out
+        // in order too.
+        collectView(m_map, x, y, m_radius, corners->data(),
+                    [&](int tile_x, int tile_y) {
+                        (*rows)[tile_y - top] |=
+                            std::uint64_t(1) << (tile_x - left);
+
+                        std::uint32_t index = static_cast<std::uint32_t>(
+                                                m_map.TileIndex(tile_x,
+                                                                tile_y));
+                        auto door = std::lower_bound(m_doors.begin(),
+                                                     m_doors.end(), index);
+                        if (door != m_doors.end() && *door == index) {
+                            doors.push_back(static_cast<std::uint32_t>(
+                                                door - m_doors.begin()));
+                        }
+                    });
+
+        int first = 0;
+        int last = 2 * r;
+        while (first <= last && (*rows)[first] == 0) {
+            first++;
+        }
+        while (last >= first && (*rows)[last] == 0) {
+            last--;
+        }
+
+        std::size_t header = sets->size();
+        sets->resize(header + SET_HEADER_BYTES);
+        (*sets)[header + 1] = static_cast<std::uint8_t>(first);
+
+        std::size_t door_words = 0;
+        for (std::size_t i = 0; i < doors.size(); door_words++) {
+            std::uint32_t word = doors[i] / 64;
+            std::uint64_t mask = 0;
+            for (; i < doors.size() && doors[i] / 64 == word; i++) {
+                mask |= std::uint64_t(1) << (doors[i] % 64);
+            }
+
+            std::uint8_t bytes[SET_DOOR_BYTES];
+            std::memcpy(bytes, &word, sizeof(word));
+            std::memcpy(bytes + SET_DOOR_MASK, &mask, sizeof(mask));
+            sets->insert(sets->end(), bytes, bytes + SET_DOOR_BYTES);
+        }
+        (*sets)[header] = static_cast<std::uint8_t>(door_words);
+
+        // Rows that are alike once cut down to the sight circle share their
+        // runs, which mostly leaves a group for each room in sight. A row
+        // joins the group if the runs of them all put together still give
+        // each row of the group exactly.
+        int groups = 0;
+        for (int row = first; row <= last; groups++) {
+            std::size_t   group = sets->size();
+            std::uint64_t bits = (*rows)[row];
+            int           count = 1;
+            for (; row + count <= last; count++) {
+                std::uint64_t joined = bits | (*rows)[row + count];
+                int           i = 0;
+                while (i <= count &&
+                       (joined & m_disc[row + i]) == (*rows)[row + i]) {
+                    i++;
+                }
+                if (i <= count) {
+                    break;
+                }
+                bits = joined;
+            }
+            row += count;
+
+            sets->push_back(static_cast<std::uint8_t>(count));
+            sets->push_back(0);
+            while (bits != 0) {
+                int start = __builtin_ctzll(bits);
+                int length = __builtin_ctzll(~(bits >> start));
+                bits &= ~(((std::uint64_t(1) << length) - 1) << start);
+
+                sets->push_back(static_cast<std::uint8_t>(start));
+                sets->push_back(static_cast<std::uint8_t>(length));
+                (*sets)[group + 1]++;
+            }
+        }
+        (*sets)[header + 2] = static_cast<std::uint8_t>(groups);
+    }
+
+
+    void VisibilitySetBuilder::BuildRow(unsigned int y, util::ThreadPool *pool)
+    {
+        // Every tile that can be stood on gets a set, including doors.
+        std::vector<unsigned int> viewers;
+        for (unsigned int x = 0; x < m_map.Width(); x++) {
+            Tile::TileType type = m_map.GetType(x, y);
+            if (!Tile::BlocksVisibility(type) || type == Tile::DOOR_CLOSED) {
+                viewers.push_back(x);
+            }
+        }
+
+        // Cast the views a block of viewers at a time, each block with its
+        // own workspace and sets, which are then added in order.
+        const std::size_t                      BLOCK = 16;
+        std::size_t                            blocks =
+            (viewers.size() + BLOCK - 1) / BLOCK;
+        std::vector<std::vector<std::uint8_t>> block_sets(blocks);
+        std::vector<std::size_t>               ends(viewers.size());
+
+        auto buildBlock = [&](std::size_t block) {
+            std::size_t                size = 2 * m_radius + 2;
+            std::vector<std::uint8_t>  corners(size * size);
+            std::vector<std::uint64_t> rows(2 * m_radius + 1);
+
+            for (std::size_t i = block * BLOCK;
+                 i < std::min((block + 1) * BLOCK, viewers.size()); i++) {
+                BuildSet(viewers[i], y, &corners, &rows, &block_sets[block]);
+                ends[i] = block_sets[block].size();
+            }
+        };
+
+        if (pool != NULL) {
+            pool->ParallelFor(blocks, buildBlock);
+        } else {
+            for (std::size_t block = 0; block < blocks; block++) {
+                buildBlock(block);
+            }
+        }
+
+        for (std::size_t i = 0; i < viewers.size(); i++) {
+            std::size_t start = i % BLOCK == 0 ? 0 : ends[i - 1];
+            m_slots[m_map.TileIndex(viewers[i], y)] =
+                static_cast<std::uint32_t>(m_sets.size() + start);
+
+            if ((i + 1) % BLOCK == 0 || i + 1 == viewers.size()) {
+                const std::vector<std::uint8_t> &sets = block_sets[i / BLOCK];
+                m_sets.insert(m_sets.end(), sets.begin(), sets.end());
+            }
+        }
+    }
+
+
+    void VisibilitySetBuilder::Finish()
+    {
+        if (m_sets.size() >= Map::NO_VISIBILITY_SET) {
+            throw std::runtime_error("Visibility sets too big");
+        }
+
+        std::size_t           slot_words = (m_slots.size() + 1) / 2;
+        std::size_t           door_words = (m_doors.size() + 1) / 2;
+        std::size_t           words = 2 + slot_words + door_words +
+                                      BitPlane::Words(m_sets.size() * 8);
+        std::shared_ptr<void> storage = allocateWords(words);
+
+        std::uint64_t *header = static_cast<std::uint64_t *>(storage.get());
+        header[0] = m_doors.size();
+        header[1] = m_sets.size();
+        std::memcpy(header + 2, m_slots.data(),
+                    m_slots.size() * sizeof(std::uint32_t));
+        std::memcpy(header + 2 + slot_words, m_doors.data(),
+                    m_doors.size() * sizeof(std::uint32_t));
+        std::memcpy(header + 2 + slot_words + door_words, m_sets.data(),
+                    m_sets.size());
+
+        if (!m_map.BindVisibilitySets(storage, words, m_radius)) {
+            throw std::runtime_error("Visibility sets don't fit the map");
+        }
+        m_map.m_viewValid = false;
+    }
+
+
+    void Map::BuildVisibilitySets(unsigned int radius, util::ThreadPool *pool)
+    {
+        VisibilitySetBuilder builder(*this, radius);
+        for (unsigned int y = 0; y < m_height; y++) {
+            builder.BuildRow(y, pool);
+        }
+        builder.Finish();
+    }
+
+
+    bool Map::BindVisibilitySets(std::shared_ptr<void> storage,
+                                 std::size_t words, unsigned int radius)
+    {
+        if (radius == 0 || radius > MAX_VISIBILITY_RADIUS || words < 2) {
+            return false;
+        }
+
+        const std::uint64_t *header =
+            static_cast<const std::uint64_t *>(storage.get());
+        std::size_t          slot_words = (m_tileCount + 1) / 2;
+        std::uint64_t        doors = header[0];
+        std::uint64_t        bytes = header[1];
+        if (doors > m_tileCount || bytes >= NO_VISIBILITY_SET ||
+            words != 2 + slot_words + (doors + 1) / 2 +
+                     BitPlane::Words(bytes * 8)) {
+            return false;
+        }
+
+        // Check the doors, and every set, so that a corrupt file can't point
+        // the map off its own tiles.
+        const std::uint32_t *slots =
+            reinterpret_cast<const std::uint32_t *>(header + 2);
+        const std::uint32_t *door_tiles =
+            reinterpret_cast<const std::uint32_t *>(header + 2 + slot_words);
+        const std::uint8_t  *sets =
+            reinterpret_cast<const std::uint8_t *>(
+                header + 2 + slot_words + (doors + 1) / 2);
+        for (std::size_t i = 0; i < doors; i++) {
+            if (door_tiles[i] >= m_tileCount ||
+                (i > 0 && door_tiles[i] <= door_tiles[i - 1])) {
+                return false;
+            }
+        }
+        for (std::size_t i = 0; i < m_tileCount; i++) {
+            if (slots[i] != NO_VISIBILITY_SET &&
+                (slots[i] >= bytes ||
+                 checkSet(sets + slots[i], bytes - slots[i],
+                          (doors + 63) / 64, radius, TileX(i), TileY(i),
+                          m_width, m_height) == 0)) {
+                return false;
+            }
+        }
+
+        m_visibilityRadius = radius;
+        m_visibilityStorage = storage;
+        m_visibilityWords = words;
+        m_visibilitySlots = slots;
+        m_visibilitySets = sets;
+        m_visibilityDisc = discRows(radius);
+        m_doors.assign(door_tiles, door_tiles + doors);
+
+        m_closedDoors.assign((doors + 63) / 64, 0);
+        for (std::size_t i = 0; i < doors; i++) {
+            if (Tile::BlocksVisibility(GetType(m_doors[i]))) {
+                m_closedDoors[i / 64] |= std::uint64_t(1) << (i % 64);
+            }
+        }
+        return true;
+    }
+
+
+    void Map::SetDoorState(std::size_t index, Tile::TileType type)
+    {
+        auto door = std::lower_bound(m_doors.begin(), m_doors.end(), index);
+        if (door == m_doors.end() || *door != index) {
+            return;
+        }
+
+        std::size_t   i = door - m_doors.begin();
+        std::uint64_t bit = std::uint64_t(1) << (i % 64);
+        if (Tile::BlocksVisibility(type)) {
+            m_closedDoors[i / 64] |= bit;
+        } else {
+            m_closedDoors[i / 64] &= ~bit;
+        }
+    }
+
+
+    const std::uint8_t * Map::VisibilitySet(unsigned int x,
+                                            unsigned int y) const
+    {
+        if (m_visibilityRadius == 0) {
+            return NULL;
+        }
+
+        std::uint32_t slot = m_visibilitySlots[TileIndex(x, y)];
+        if (slot == NO_VISIBILITY_SET) {
+            return NULL;
+        }
+
+        // The set was found with the doors open, so it only stands if none
+        // of the doors it can see are closed.
+        const std::uint8_t *set = m_visibilitySets + slot;
+        const std::uint8_t *door = set + SET_HEADER_BYTES;
+        for (unsigned int i = 0; i < set[0]; i++, door += SET_DOOR_BYTES) {
+            std::uint32_t word;
+            std::uint64_t mask;
+            std::memcpy(&word, door, sizeof(word));
+            std::memcpy(&mask, door + SET_DOOR_MASK, sizeof(mask));
+            if (m_closedDoors[word] & mask) {
+                return NULL;
+            }
+        }
+
+        return set;
+    }
+
+
+    bool Map::ApplyVisibilitySet(unsigned int x, unsigned int y)
+    {
+        const std::uint8_t *set = VisibilitySet(x, y);
+        if (set == NULL) {
+            return false;
+        }
+
+        ClearVisibleTiles();
+        m_viewValid = false;
+
+        int r = static_cast<int>(m_visibilityRadius);
+        forEachRun(set, m_visibilityDisc, [&](int row, int start,
+                                              int length) {
+            std::size_t index = TileIndex(static_cast<int>(x) + start - r,
+                                          static_cast<int>(y) + row - r);
+            for (std::size_t end = index + length; index < end; index++) {
+                m_visible.Set(index, true);
+                m_seen.Set(index, true);
+                m_visibleTiles.push_back(index);
+            }
+        });
+
+        return true;
+    }
+
+
+    void Map::FindViews(const std::vector<Observer> &observers,
+                        ObserverViews               *views,
+                        util::ThreadPool            *pool) const
+    {
+        unsigned int max_radius = 0;
+        std::size_t  total = 0;
+
+        views->m_offsets.clear();
+        for (auto &&o : observers) {
+            if (o.x >= m_width || o.y >= m_height) {
+                throw std::runtime_error("Observer is off the map");
+            }
+            if (o.radius > MAX_VISIBILITY_RADIUS) {
+                throw std::runtime_error("Observer radius out of range");
+            }
+
+            views->m_offsets.push_back(total);
+            total += 2 * o.radius + 1;
+            max_radius = std::max(max_radius, o.radius);
+        }
+        views->m_offsets.push_back(total);
+        views->m_width = m_width;
+        views->m_observers = observers;
+        views->m_rows.assign(total, 0);
+
+        // Each block of observers gets its own workspace; the views are
+        // written to separate words, so the blocks never share one.
+        const std::size_t BLOCK = 64;
+        auto findBlock = [&](std::size_t block) {
+            std::size_t               size = 2 * max_radius + 2;
+            std::vector<std::uint8_t> corners(size * size);
+
+            for (std::size_t i = block * BLOCK;
+                 i < std::min((block + 1) * BLOCK, observers.size()); i++) {
+                const Observer &o = observers[i];
+                int             r = static_cast<int>(o.radius);
+                std::uint64_t  *rows = &views->m_rows[views->m_offsets[i]];
+
+                const std::uint8_t *set = NULL;
+                if (o.radius == m_visibilityRadius) {
+                    set = VisibilitySet(o.x, o.y);
+                }
+
+                if (set != NULL) {
+                    forEachRun(set, m_visibilityDisc,
+                               [rows](int row, int start, int length) {
+                                   rows[row] |=
+                                       ((std::uint64_t(1) << length) - 1) <<
+                                       start;
+                               });
+                    continue;
+                }
+
+                std::size_t used = (2 * o.radius + 2) * (2 * o.radius + 2);
+                std::fill(corners.begin(), corners.begin() + used, 0);
+                castView(*this, o.x, o.y, o.radius, false, corners.data(),
+                         ALL_OCTANTS);
+
+                auto mark = [&](int tile_x, int tile_y) {
+                    int dx = tile_x - static_cast<int>(o.x);
+                    int dy = tile_y - static_cast<int>(o.y);
+                    rows[dy + r] |= std::uint64_t(1) << (dx + r);
+                };
+                collectView(*this, o.x, o.y, o.radius, corners.data(), mark);
+            }
+        };
+
+        std::size_t blocks = (observers.size() + BLOCK - 1) / BLOCK;
+        if (pool != NULL) {
+            pool->ParallelFor(blocks, findBlock);
+        } else {
+            for (std::size_t block = 0; block < blocks; block++) {
+                findBlock(block);
+            }
+        }
+    }
+
+
+    std::size_t ObserverViews::Count(std::size_t i) const
+    {
+        std::size_t count = 0;
+        for (std::size_t row = m_offsets[i]; row < m_offsets[i + 1]; row++) {
+            count += __builtin_popcountll(m_rows[row]);
+        }
+        return count;
+    }
+
+
+    void ObserverViews::GetTiles(std::size_t               i,
+                                 std::vector<std::size_t> *tiles) const
+    {
+        const Observer &o = m_observers[i];
+        int             r = static_cast<int>(o.radius);
+
+        for (std::size_t row = m_offsets[i]; row < m_offsets[i + 1]; row++) {
+            std::size_t   y = o.y + (row - m_offsets[i]) - r;
+            std::uint64_t bits = m_rows[row];
+            while (bits != 0) {
+                std::size_t x = o.x + __builtin_ctzll(bits) - r;
+                bits &= bits - 1;
+                tiles->push_back(y * m_width + x);
+            }
+        }
+    }
+
+
+    void Map::UpdateVisibility(unsigned int x, unsigned int y,
+                               unsigned int radius)
+    {
+        if (radius == m_visibilityRadius && ApplyVisibilitySet(x, y)) {
+            return;
+        }
+
+        unsigned int octants = m_staleOctants;
+
+        if (!m_viewValid || x != m_viewX || y != m_viewY ||
+            radius != m_viewRadius) {
+            std::size_t size = 2 * radius + 2;
+            m_viewCorners.assign(size * size, 0);
+            m_viewX = x;
+            m_viewY = y;
+            m_viewRadius = radius;
+            m_viewValid = true;
+            octants = ALL_OCTANTS;
+        } else if (octants == 0) {
+            return;
+        } else {
+            // Only the octants a changed tile is in need casting again.
+            for (auto &&corner : m_viewCorners) {
+                corner &= static_cast<std::uint8_t>(~octants);
+            }
+        }
+
+        castView(*this, x, y, radius, false, m_viewCorners.data(), octants);
+        m_staleOctants = 0;
+
+        ClearVisibleTiles();
+        collectView(*this, x, y, radius, m_viewCorners.data(),
+                    [this](int tile_x, int tile_y) {
+                        std::size_t index = TileIndex(tile_x, tile_y);
+                        m_visible.Set(index, true);
+                        m_seen.Set(index, true);
+                        m_visibleTiles.push_back(index);
+                    });
+    }
+
+
+    void Map::InvalidateVisibility(std::size_t index)
+    {
+        if (!m_viewValid) {
+            return;
+        }
+
+        // Find the octants that look at the tile from any of the corners of
+        // the viewer's tile, working in coordinates doubled so that the
+        // tile's centre falls on whole numbers.
+        int reach = 2 * static_cast<int>(m_viewRadius) + 2;
+        for (unsigned int corner = 0; corner < 4; corner++) {
+            int centrex = 2 * (static_cast<int>(TileX(index)) -
+                               static_cast<int>(m_viewX + (corner & 1))) + 1;
+            int centrey = 2 * (static_cast<int>(TileY(index)) -
+                               static_cast<int>(m_viewY + (corner >> 1))) + 1;
+
+            for (unsigned int i = 0; i < 8; i++) {
+                const Octant &o = OCTANTS[i];
+                int           along = o.xx * centrex + o.yx * centrey;
+                int           across = o.xy * centrex + o.yy * centrey;
+
+                if (along > 0 && along < reach &&
+                    ((across > 0 && across <= along) ||
+                     (o.axis && across == -1))) {
+                    m_staleOctants |= 1 << i;
+                }
+            }
+        }
+    }
+
+
+    void Map::ClearVisibleTiles()
+    {
+        if (m_visibleListed) {
+            for (auto index : m_visibleTiles) {
+                m_visible.Set(index, false);
+            }
+        } else {
+            m_visible.Clear();
+            m_visibleListed = true;
+        }
+        m_visibleTiles.clear();
+    }
+
+
+    std::size_t Map::GetTileNeighbours(
+                        std::size_t                 index,
+                        std::array<std::size_t, 8> &neighbours,
+                        bool                        diags) const
+    {
+        unsigned int x = TileX(index);
+        unsigned int y = TileY(index);
+        std::size_t count = 0;
+
+        if (x > 0) {
+            neighbours[count++] = index - 1;
+        }
+
+        if (x < m_width - 1) {
+            neighbours[count++] = index + 1;
+        }
+
+        if (y > 0) {
+            neighbours[count++] = index - m_width;
+        }
+
+        if (y < m_height - 1) {
+            neighbours[count++] = index + m_width;
         }
 
         if (diags) {
-            if (tile->x > 0 && tile->y > 0) {
-                neighbours.push_back(
-                    &m_tiles[CoordsToTileIndex(tile->x - 1, tile->y - 1)]);
+            if (x > 0 && y > 0) {
+                neighbours[count++] = index - m_width - 1;
             }
 
-            if (tile->x > 0 && tile->y < MAP_HEIGHT - 1) {
-                neighbours.push_back(
-                    &m_tiles[CoordsToTileIndex(tile->x - 1, tile->y + 1)]);
+            if (x > 0 && y < m_height - 1) {
+                neighbours[count++] = index + m_width - 1;
             }
 
-            if (tile->x < MAP_WIDTH - 1 && tile->y > 0) {
-                neighbours.push_back(
-                    &m_tiles[CoordsToTileIndex(tile->x + 1, tile->y - 1)]);
+            if (x < m_width - 1 && y > 0) {
+                neighbours[count++] = index - m_width + 1;
             }
 
-            if (tile->x < MAP_WIDTH - 1 && tile->y < MAP_WIDTH - 1) {
-                neighbours.push_back(
-                    &m_tiles[CoordsToTileIndex(tile->x + 1, tile->y + 1)]);
+            if (x < m_width - 1 && y < m_height - 1) {
+                neighbours[count++] = index + m_width + 1;
             }
         }
 
-        return neighbours;
+        return count;
+    }
+
+
+    const ItemVector & Map::GetItems(std::size_t index) const
+    {
+        static const ItemVector empty;
+
+        auto iter = m_items.find(index);
+        return iter != m_items.end() ? iter->second : empty;
+    }
+
+
+    ItemVector Map::TakeItems(std::size_t index)
+    {
+        ItemVector items;
+
+        auto iter = m_items.find(index);
+        if (iter != m_items.end()) {
+            items.swap(iter->second);
+            m_items.erase(iter);
+        }
+
+        return items;
     }
 }
@@ -3,17 +3,25 @@
 
 
 #include <array>
+#include <atomic>
 #include <vector>
 #include <algorithm>
 #include <memory>
+#include <mutex>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "graph.hpp"
 #include "item.hpp"
+#include "room.hpp"
+#include "threadpool.hpp"
 
 namespace dungeon
 {
     struct Tile
     {
         public:
-            enum TileType {
+            enum TileType : std::uint8_t {
                 FLOOR,
                 WALL,
                 STAIRS,
@@ -22,108 +30,715 @@ namespace dungeon
                 EMPTY
             };
 
-            Tile() : type(EMPTY)
+            static bool IsEmpty(TileType type)
             {
+                return type == EMPTY;
             }
 
-            bool IsEmpty() const
+            static bool BlocksVisibility(TileType type)
             {
-                return type == EMPTY;
+                return type == WALL || type == DOOR_CLOSED || type == EMPTY;
+            }
+    };
+
+
+    /*
+     * BitPlane
+     *
+     * A single flag for every tile of a map, packed 64 to a word. The words
+     * belong to the map's storage, the plane is only a view of them.
+     */
+    class BitPlane
+    {
+        public:
+            BitPlane()
+                : m_words(NULL), m_count(0)
+            {
+            }
+
+            BitPlane(std::uint64_t *words, std::size_t count)
+                : m_words(words), m_count(count)
+            {
+            }
+
+            // The number of words needed to hold a flag for each of size
+            // tiles.
+            static std::size_t Words(std::size_t size)
+            {
+                return (size + 63) / 64;
+            }
+
+            bool Get(std::size_t index) const
+            {
+                return (m_words[index / 64] >> (index % 64)) & 1;
+            }
+
+            void Set(std::size_t index, bool value)
+            {
+                std::uint64_t mask = std::uint64_t(1) << (index % 64);
+                if (value) {
+                    m_words[index / 64] |= mask;
+                } else {
+                    m_words[index / 64] &= ~mask;
+                }
+            }
+
+            void Clear()
+            {
+                std::fill(m_words, m_words + m_count, 0);
             }
-            
+
+            // Find the first set flag, returning false if there is none.
+            bool FindFirst(std::size_t *index) const
+            {
+                for (std::size_t i = 0; i < m_count; i++) {
+                    if (m_words[i] != 0) {
+                        std::size_t bit = 0;
+                        while (((m_words[i] >> bit) & 1) == 0) {
+                            bit++;
+                        }
+                        *index = i * 64 + bit;
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+        private:
+            std::uint64_t *m_words;
+            std::size_t    m_count;
+    };
+
+
+    /*
+     * BasicTileRef
+     *
+     * A handle on a single tile of a map, giving a per-tile view of the map's
+     * planes for code that works with one tile at a time. Code that scans
+     * the whole map should use the map's plane accessors instead.
+     */
+    template <class MapType>
+    class BasicTileRef
+    {
+        public:
+            BasicTileRef(MapType &map, std::size_t index)
+                : m_map(&map), m_index(index)
+            {
+            }
+
+            std::size_t Index() const { return m_index; }
+            unsigned int X() const { return m_map->TileX(m_index); }
+            unsigned int Y() const { return m_map->TileY(m_index); }
+
+            Tile::TileType Type() const { return m_map->GetType(m_index); }
+            bool IsEmpty() const { return Tile::IsEmpty(Type()); }
             bool BlocksVisibility() const
             {
-                return type == WALL || type == DOOR_CLOSED || type == EMPTY;
+                return Tile::BlocksVisibility(Type());
+            }
+
+            bool IsSpawn() const { return m_map->IsSpawn(m_index); }
+            bool IsVisible() const { return m_map->IsTileVisible(m_index); }
+            bool IsSeen() const { return m_map->IsTileSeen(m_index); }
+            bool HasItems() const { return m_map->HasItems(m_index); }
+            const ItemVector & Items() const
+            {
+                return m_map->GetItems(m_index);
+            }
+
+            void SetType(Tile::TileType type) const
+            {
+                m_map->SetType(m_index, type);
+            }
+
+            void SetSpawn(bool spawn) const
+            {
+                m_map->SetSpawn(m_index, spawn);
+            }
+
+            void SetVisible(bool visible) const
+            {
+                m_map->SetTileVisible(m_index, visible);
             }
 
-            unsigned int x;
-            unsigned int y;
-            TileType     type;
-            bool         spawn;
-            bool         visible;
-            bool         seen;
-            ItemVector   items;
+            void SetSeen(bool seen) const
+            {
+                m_map->SetTileSeen(m_index, seen);
+            }
+
+        private:
+            MapType     *m_map;
+            std::size_t  m_index;
     };
 
-    
-    class Map
+
+    /*
+     * Observer
+     *
+     * Something looking out over a map from a tile, as far as its sight
+     * radius.
+     */
+    struct Observer
+    {
+        unsigned int x;
+        unsigned int y;
+        unsigned int radius;
+    };
+
+
+    /*
+     * ObserverViews
+     *
+     * The fields of view of a batch of observers, found together by
+     * Map::FindViews. Each view is a square of bits centred on its observer,
+     * a word to a row, so a view of radius r takes 2r + 1 words. All the
+     * views share one block, which is kept from batch to batch.
+     */
+    class ObserverViews
     {
         public:
-            static const unsigned int MAP_HEIGHT = 120;
-            static const unsigned int MAP_WIDTH = 160;
+            ObserverViews() : m_width(0) {}
 
-            using TileArray = std::array<Tile, Map::MAP_WIDTH * Map::MAP_HEIGHT>;
-            using TileIter = TileArray::iterator;
-            using ConstTileIter = TileArray::const_iterator;
+            std::size_t Size() const { return m_observers.size(); }
+            const Observer & GetObserver(std::size_t i) const
+            {
+                return m_observers[i];
+            }
 
-            Map()
+            // Whether observer i can see the tile at (x, y).
+            bool CanSee(std::size_t i, unsigned int x, unsigned int y) const
             {
-                // Initialize the tile array. Tiles know their own location,
-                // for pathfinding.
-                for (TileArray::size_type i = 0; i < m_tiles.size(); i++) {
-                    m_tiles[i].x = i % MAP_WIDTH;
-                    m_tiles[i].y = i / MAP_WIDTH;
-                    m_tiles[i].type = Tile::EMPTY;
-                    m_tiles[i].spawn = false;
-                    m_tiles[i].visible = false;
-                    m_tiles[i].seen = false;
+                const Observer &o = m_observers[i];
+                int             r = static_cast<int>(o.radius);
+                int             dx = static_cast<int>(x - o.x);
+                int             dy = static_cast<int>(y - o.y);
 
+                if (dx < -r || dx > r || dy < -r || dy > r) {
+                    return false;
                 }
+                return (m_rows[m_offsets[i] + dy + r] >> (dx + r)) & 1;
             }
 
-            std::vector<Tile *> GetTileNeighbours (Tile *tile,
-                                                   bool  diags = true);
+            // The number of tiles observer i can see.
+            std::size_t Count(std::size_t i) const;
+
+            // Append the indices of the tiles observer i can see.
+            void GetTiles(std::size_t i, std::vector<std::size_t> *tiles) const;
+
+        private:
+            friend class Map;
+
+            unsigned int               m_width;
+            std::vector<Observer>      m_observers;
+            std::vector<std::size_t>   m_offsets;
+            std::vector<std::uint64_t> m_rows;
+    };
+
+
+    /*
+     * Map
+     *
+     * The tiles of a level, stored as a structure of arrays: a byte per tile
+     * for the tile type and bit planes for the per-tile flags. Items are few
+     * and far between, so they are kept in a sparse map from tile index to
+     * the items on that tile. Tile coordinates are not stored, but derived
+     * from the tile's index.
+     *
+     * The planes all live in one storage block, laid out exactly as in a
+     * level file, so that a saved level can be loaded by mapping the file
+     * and pointing the planes into it. The map also keeps the rooms and the
+     * connections between them that the level was built from.
+     */
+    class Map
+    {
+        friend class VisibilitySetBuilder;
+
+        public:
+            // The size of the levels played in the game.
+            static const unsigned int DEFAULT_WIDTH = 160;
+            static const unsigned int DEFAULT_HEIGHT = 120;
+
+            using TileRef = BasicTileRef<Map>;
+            using ConstTileRef = BasicTileRef<const Map>;
+            using ItemMap = std::unordered_map<std::size_t, ItemVector>;
+
+            Map(unsigned int width = DEFAULT_WIDTH,
+                unsigned int height = DEFAULT_HEIGHT);
+            Map(const Map &other);
+            Map & operator=(const Map &other);
+
+            // Write the map to a level file, throwing std::runtime_error on
+            // failure.
+            void Save(const std::string &path) const;
+
+            // Load a level file written by Save, throwing std::runtime_error
+            // if it can't be read or isn't a level file. Where the platform
+            // allows, the file is mapped rather than read, and the tile planes
+            // are used in place; changes made to the map are not written back
+            // to the file.
+            static std::shared_ptr<Map> Load(const std::string &path);
+
+            // The number of 64 bit words of storage needed for the planes of
+            // a map of a given size.
+            static std::size_t StorageWords(std::size_t tiles)
+            {
+                return (tiles + 7) / 8 + 3 * BitPlane::Words(tiles);
+            }
+
+            // Find the neighbours of a tile, returning how many there are.
+            std::size_t GetTileNeighbours(
+                            std::size_t                 index,
+                            std::array<std::size_t, 8> &neighbours,
+                            bool                        diags = true) const;
+
+            // Whether any corner of the tile at (endx, endy) can be seen from
+            // any corner of the tile at (startx, starty). Sight is blocked
+            // by a tile a ray passes through, or, for a ray along a grid
+            // line, by the tiles either side of it. Tiles off the map block
+            // sight.
             bool IsVisible(unsigned int startx, unsigned int starty,
                            unsigned int endx, unsigned int endy) const;
 
-            TileIter beginTiles() { return m_tiles.begin(); }
-            TileIter endTiles() { return m_tiles.end(); }
-            ConstTileIter beginTiles() const { return m_tiles.begin(); }
-            ConstTileIter endTiles() const { return m_tiles.end(); }
-            ConstTileIter cbeginTiles() const { return m_tiles.cbegin(); }
-            ConstTileIter cendTiles() const { return m_tiles.cend(); }
+            // IsVisible found by tracing each ray a grid line crossing at a
+            // time, reading the tile types. Much slower; IsVisible is
+            // checked against it. The tiles must not be on the edge of the
+            // map.
+            bool IsVisibleTraced(unsigned int startx, unsigned int starty,
+                                 unsigned int endx, unsigned int endy) const;
 
-            unsigned int Width() const { return MAP_WIDTH; }
-            unsigned int Height() const { return MAP_HEIGHT; }
+            unsigned int Width() const { return m_width; }
+            unsigned int Height() const { return m_height; }
+            std::size_t TileCount() const { return m_tileCount; }
 
-            Tile& GetTile(unsigned int x, unsigned int y)
+            std::size_t TileIndex(unsigned int x, unsigned int y) const
             {
-                return m_tiles[CoordsToTileIndex(x, y)];
+                return (static_cast<std::size_t>(y) * m_width + x);
             }
 
-            const Tile& GetTile(unsigned int x, unsigned int y) const
+            unsigned int TileX(std::size_t index) const
             {
-                return m_tiles[CoordsToTileIndex(x, y)];
+                return static_cast<unsigned int>(index % m_width);
             }
 
-            void Clear()
+            unsigned int TileY(std::size_t index) const
+            {
+                return static_cast<unsigned int>(index / m_width);
+            }
+
+            Tile::TileType GetType(std::size_t index) const
+            {
+                return static_cast<Tile::TileType>(m_types[index]);
+            }
+
+            Tile::TileType GetType(unsigned int x, unsigned int y) const
+            {
+                return GetType(TileIndex(x, y));
+            }
+
+            void SetType(std::size_t index, Tile::TileType type)
             {
-                for (auto &&tile : m_tiles) {
-                    tile.type = Tile::EMPTY;
+                m_types[index] = type;
+                if (m_blockersFound.load(std::memory_order_relaxed)) {
+                    SetBlocker(TileX(index), TileY(index),
+                               Tile::BlocksVisibility(type));
+                }
+                if (!m_doors.empty()) {
+                    SetDoorState(index, type);
                 }
             }
 
-            void ResetVisibility()
+            void SetType(unsigned int x, unsigned int y, Tile::TileType type)
             {
-                for (auto &&tile : m_tiles) {
-                    tile.visible = false;
+                SetType(TileIndex(x, y), type);
+            }
+
+            // The tile type plane, one byte per tile in index order.
+            const std::uint8_t * Types() const
+            {
+                return m_types;
+            }
+
+            bool IsSpawn(std::size_t index) const { return m_spawn.Get(index); }
+            bool IsTileVisible(std::size_t index) const
+            {
+                return m_visible.Get(index);
+            }
+            bool IsTileSeen(std::size_t index) const
+            {
+                return m_seen.Get(index);
+            }
+
+            void SetSpawn(std::size_t index, bool spawn)
+            {
+                m_spawn.Set(index, spawn);
+            }
+
+            void SetTileVisible(std::size_t index, bool visible)
+            {
+                m_visible.Set(index, visible);
+                m_visibleListed = false;
+            }
+
+            void SetTileSeen(std::size_t index, bool seen)
+            {
+                m_seen.Set(index, seen);
+            }
+
+            // Find the player's spawn point, returning false if the map has
+            // none.
+            bool FindSpawn(unsigned int *x, unsigned int *y) const
+            {
+                std::size_t index;
+                if (!m_spawn.FindFirst(&index)) {
+                    return false;
                 }
+                *x = TileX(index);
+                *y = TileY(index);
+                return true;
+            }
+
+            bool HasItems(std::size_t index) const
+            {
+                return m_items.find(index) != m_items.end();
+            }
+
+            // The items on a tile, empty if there are none.
+            const ItemVector & GetItems(std::size_t index) const;
+
+            // Make room in the map's item arena for a number of items.
+            void ReserveItems(std::size_t count)
+            {
+                if (!m_itemArena) {
+                    m_itemArena = std::make_shared<ItemArena>(count);
+                }
+            }
+
+            // Create an item on a tile, owned by the map's item arena.
+            ItemHandle CreateItem(std::size_t index)
+            {
+                ReserveItems(0);
+                ItemHandle item = m_itemArena->Create();
+                m_items[index].push_back(item);
+                return item;
+            }
+
+            // The arena owning the map's items, NULL if it has none.
+            const std::shared_ptr<ItemArena> & GetItemArena() const
+            {
+                return m_itemArena;
+            }
+
+            // Remove the items from a tile, returning them.
+            ItemVector TakeItems(std::size_t index);
+
+            // Iterate over the tiles that have items on them, as pairs of
+            // tile index and items, in no particular order.
+            ItemMap::const_iterator beginItems() const
+            {
+                return m_items.begin();
+            }
+
+            ItemMap::const_iterator endItems() const
+            {
+                return m_items.end();
+            }
+
+            TileRef GetTile(unsigned int x, unsigned int y)
+            {
+                return TileRef(*this, TileIndex(x, y));
+            }
+
+            ConstTileRef GetTile(unsigned int x, unsigned int y) const
+            {
+                return ConstTileRef(*this, TileIndex(x, y));
+            }
+
+            const std::vector<Room> & GetRooms() const
+            {
+                return m_rooms;
+            }
+
+            // The connections between rooms, as pairs of indices into the
+            // rooms.
+            const std::vector<graph::IndexedEdge> & GetRoomEdges() const
+            {
+                return m_roomEdges;
+            }
+
+            void SetRooms(const std::vector<Room> &rooms)
+            {
+                m_rooms = rooms;
+            }
+
+            void SetRoomEdges(const std::vector<graph::IndexedEdge> &edges)
+            {
+                m_roomEdges = edges;
+            }
+
+            void Clear()
+            {
+                std::fill(m_types, m_types + m_tileCount, Tile::EMPTY);
+                m_blockersFound = false;
+                m_viewValid = false;
+            }
+
+            void ResetVisibility()
+            {
+                ClearVisibleTiles();
+                m_viewValid = false;
+            }
+
+            // Find the tiles within radius of (x, y) that can be seen from
+            // it, as IsVisible would, appending their indices to visible.
+            // Only the tiles in range are looked at.
+            void FieldOfView(unsigned int x, unsigned int y,
+                             unsigned int radius,
+                             std::vector<std::size_t> *visible) const;
+
+            // Make the tiles within radius of (x, y) that can be seen from
+            // it the only visible tiles, and mark them as seen. The view is
+            // kept, so it is only found again if (x, y) moves or a tile in
+            // it changes.
+            void UpdateVisibility(unsigned int x, unsigned int y,
+                                  unsigned int radius);
+
+            // Note that the type of a tile has changed since the last
+            // UpdateVisibility, so that the parts of the view the tile is in
+            // are found again by the next one.
+            void InvalidateVisibility(std::size_t index);
+
+            // The largest radius visibility sets can be built for, and
+            // FindViews can look as far as.
+            static const unsigned int MAX_VISIBILITY_RADIUS = 31;
+
+            // Find the field of view of each of a batch of observers, as
+            // FieldOfView would, into views, spread across pool if one is
+            // given. The map is only read, and the visibility sets are used
+            // where they can be. Throws std::runtime_error if an observer is
+            // off the map or its radius is over MAX_VISIBILITY_RADIUS.
+            void FindViews(const std::vector<Observer> &observers,
+                           ObserverViews               *views,
+                           util::ThreadPool            *pool = NULL) const;
+
+            // Work out the tiles visible within radius from every tile that
+            // can be stood on, with the doors open, spread across pool if
+            // one is given. These visibility sets are kept with the map,
+            // and saved with it. UpdateVisibility with the same radius uses
+            // them rather than finding the view, unless there is a closed
+            // door in sight. Throws std::runtime_error if the radius is 0 or
+            // over MAX_VISIBILITY_RADIUS. VisibilitySetBuilder does the same
+            // a row at a time.
+            void BuildVisibilitySets(unsigned int      radius,
+                                     util::ThreadPool *pool = NULL);
+
+            // The radius the visibility sets were built for, 0 if there are
+            // none.
+            unsigned int VisibilitySetRadius() const
+            {
+                return m_visibilityRadius;
+            }
+
+            // The size of the visibility sets, in 64 bit words.
+            std::size_t VisibilitySetWords() const
+            {
+                return m_visibilityWords;
             }
 
 
         private:
+            // Point the planes at a storage block of StorageWords() words.
+            void BindPlanes(std::shared_ptr<void> storage);
+
+            // Clear the visible plane, touching only the visible tiles when
+            // they are known.
+            void ClearVisibleTiles();
+
+            // Use visibility sets held in a block of words, as laid out by
+            // VisibilitySetBuilder, returning false if they don't fit the
+            // map.
+            bool BindVisibilitySets(std::shared_ptr<void> storage,
+                                    std::size_t words, unsigned int radius);
+
+            // Note the new type of a tile in the door state mask, if it is
+            // one of the doors the visibility sets know of.
+            void SetDoorState(std::size_t index, Tile::TileType type);
+
+            // The visibility set of (x, y), or NULL if it has none or a
+            // closed door in it would block part of it.
+            const std::uint8_t * VisibilitySet(unsigned int x,
+                                               unsigned int y) const;
+
+            // Make the visibility set of (x, y) the visible tiles, returning
+            // false if there is no usable set.
+            bool ApplyVisibilitySet(unsigned int x, unsigned int y);
+
+            static const std::uint32_t NO_VISIBILITY_SET = 0xffffffff;
+
+            bool BlocksVisibility(unsigned int x, unsigned int y) const
+            {
+                return Tile::BlocksVisibility(GetType(x, y));
+            }
+
+            // Fill the blocker boards from the tile types, unless they
+            // already have been. Safe to call from several threads at once.
+            void FindBlockers() const;
+
+            // Mark whether the tile at (x, y) blocks sight on the blocker
+            // boards.
+            void SetBlocker(unsigned int x, unsigned int y, bool blocks) const
+            {
+                std::uint64_t *row = &m_blockerRows[
+                                        (y + 1) * m_blockerRowWords +
+                                        (x + 1) / 64];
+                std::uint64_t *column = &m_blockerColumns[
+                                           (x + 1) * m_blockerColumnWords +
+                                           (y + 1) / 64];
+                std::uint64_t  row_bit = std::uint64_t(1) << ((x + 1) % 64);
+                std::uint64_t  column_bit = std::uint64_t(1) <<
+                                            ((y + 1) % 64);
+
+                if (blocks) {
+                    *row |= row_bit;
+                    *column |= column_bit;
+                } else {
+                    *row &= ~row_bit;
+                    *column &= ~column_bit;
+                }
+            }
+
+            // Whether the tile at (x, y), which may be one off the map,
+            // blocks sight, going by the blocker boards.
+            bool IsBlocker(int x, int y) const
+            {
+                return (m_blockerRows[(y + 1) * m_blockerRowWords +
+                                      (x + 1) / 64] >> ((x + 1) % 64)) & 1;
+            }
+
+            // Whether the ray between two tile corners is blocked, going by
+            // the blocker boards.
+            bool RayBlocked(int startx, int starty, int endx, int endy) const;
+
             bool CheckCornerVisibility(unsigned int cornerx, unsigned int cornery,
                                        int signx, int signy) const;
             bool CheckRayVisibility(unsigned int startx, unsigned int starty,
                                     unsigned int endx, unsigned int endy) const;
 
+            unsigned int                    m_width;
+            unsigned int                    m_height;
+            std::size_t                     m_tileCount;
+            std::shared_ptr<void>           m_storage;
+            std::uint8_t                   *m_types;
+            BitPlane                        m_spawn;
+            BitPlane                        m_visible;
+            BitPlane                        m_seen;
+            ItemMap                         m_items;
+            std::shared_ptr<ItemArena>      m_itemArena;
+            std::vector<Room>               m_rooms;
+            std::vector<graph::IndexedEdge> m_roomEdges;
 
-            std::size_t CoordsToTileIndex(unsigned int x, unsigned int y) const
+            // The tiles that block sight, a bit per tile, by row and by
+            // column, with a ring of blocking tiles around the map so that
+            // rays along its edges need no bounds checks. Tile (x, y) is bit
+            // x + 1 of row y + 1, and bit y + 1 of column x + 1. The boards
+            // are only filled in once IsVisible needs them, so building a
+            // level doesn't pay for keeping them up to date; from then on
+            // SetType keeps them.
+            mutable std::vector<std::uint64_t> m_blockerRows;
+            mutable std::size_t                m_blockerRowWords;
+            mutable std::vector<std::uint64_t> m_blockerColumns;
+            mutable std::size_t                m_blockerColumnWords;
+            mutable std::atomic<bool>          m_blockersFound;
+            mutable std::mutex                 m_blockersMutex;
+
+            // The tiles in the visible plane, unless it has been set some
+            // other way than UpdateVisibility.
+            std::vector<std::size_t>        m_visibleTiles;
+            bool                            m_visibleListed;
+
+            // The view UpdateVisibility last found, as the corners seen
+            // around it with a bit for each octant they were seen in, and
+            // the octants a changed tile is in.
+            bool                            m_viewValid;
+            unsigned int                    m_viewX;
+            unsigned int                    m_viewY;
+            unsigned int                    m_viewRadius;
+            std::vector<std::uint8_t>       m_viewCorners;
+            unsigned int                    m_staleOctants;
+
+            // The visibility sets, in one storage block laid out as
+            // VisibilitySetBuilder describes, the columns of each row of the
+            // sight square in the sight circle, and the doors the sets were
+            // built with. The door state mask has a bit for each of the
+            // doors, set while it blocks sight.
+            unsigned int                    m_visibilityRadius;
+            std::shared_ptr<void>           m_visibilityStorage;
+            const std::uint32_t            *m_visibilitySlots;
+            const std::uint8_t             *m_visibilitySets;
+            std::size_t                     m_visibilityWords;
+            std::vector<std::uint64_t>      m_visibilityDisc;
+            std::vector<std::uint32_t>      m_doors;
+            std::vector<std::uint64_t>      m_closedDoors;
+    };
+
+
+    /*
+     * VisibilitySetBuilder
+     *
+     * Builds the visibility sets of a map a row of viewers at a time, so that
+     * a caller with other work to do can spread the build over many short
+     * steps. The map must not change until the sets are finished.
+     *
+     * The sets are held in one block of words: the number of doors and the
+     * number of bytes of sets, then the byte offset of each tile's set, or
+     * NO_VISIBILITY_SET, as 32 bit numbers padded to a whole word, then the
+     * tile index of each door in the same way, then the sets themselves.
+     *
+     * A set starts with three bytes: the number of door words in it, the
+     * first of its rows that has anything visible, counting rows from radius
+     * above the viewer, and the number of groups of rows that follow. Each
+     * door word is a 32 bit word index into the door state mask and the 64
+     * bit mask of the doors the set can see in that word. Each group of rows
+     * is a byte giving how many rows it stands for and a byte giving their
+     * number of runs of visible tiles, then a start and length byte for each
+     * run, counting columns from radius left of the viewer. The runs of a
+     * group are cut down to the sight circle on each of its rows.
+     */
+    class VisibilitySetBuilder
+    {
+        public:
+            // Throws std::runtime_error if the radius is 0 or over
+            // Map::MAX_VISIBILITY_RADIUS.
+            VisibilitySetBuilder(Map &map, unsigned int radius);
+
+            // Build the sets of the viewers on a row of the map, spread
+            // across pool if one is given.
+            void BuildRow(unsigned int y, util::ThreadPool *pool = NULL);
+
+            // Hand the sets built to the map, replacing any it had. Throws
+            // std::runtime_error if they are too big to index.
+            void Finish();
+
+            // The size of the sets built so far, in bytes.
+            std::size_t Bytes() const
             {
-                return (y * MAP_WIDTH + x);
+                return m_sets.size();
             }
 
-            TileArray m_tiles;
+        private:
+            // Append the set of the viewer at (x, y) to sets, using corners
+            // and rows as workspace.
+            void BuildSet(unsigned int                x,
+                          unsigned int                y,
+                          std::vector<std::uint8_t>  *corners,
+                          std::vector<std::uint64_t> *rows,
+                          std::vector<std::uint8_t>  *sets) const;
+
+            Map                        &m_map;
+            unsigned int                m_radius;
+            std::vector<std::uint64_t>  m_disc;
+            std::vector<std::uint32_t>  m_doors;
+            std::vector<std::uint32_t>  m_slots;
+            std::vector<std::uint8_t>   m_sets;
     };
 }
 
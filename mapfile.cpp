@@ -0,0 +1,330 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include "map.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+/*
+ * Level files
+ *
+ * A level file is a header followed by sections, each of which starts on an
+ * 8 byte boundary:
+ *
+ *   planes  The map's storage block, as is: the tile types, one byte per
+ *           tile padded to a whole word, then the spawn, visible and seen
+ *           bit planes.
+ *   items   A LevelFileItem for each tile with items on it.
+ *   rooms   A LevelFileRoom for each room.
+ *   edges   A LevelFileEdge for each connection between rooms, by room
+ *           index.
+ *   visibility
+ *           The map's visibility sets as they are held in memory, if it has
+ *           any, for the radius in the header.
+ *
+ * Nothing is converted on the way in or out, so the planes of a mapped file
+ * can be used directly. Values are in the byte order of the machine that
+ * wrote the file, which is recorded in the header so that a file from a
+ * machine of the other order is rejected rather than misread.
+ */
+namespace dungeon
+{
+    static const char          LEVEL_MAGIC[8] = {
+        'D', 'U', 'N', 'G', 'E', 'O', 'N', '\0'
+    };
+    static const std::uint32_t LEVEL_VERSION = 4;
+    static const std::uint32_t LEVEL_BYTE_ORDER = 0x01020304;
+    static const std::uint32_t LEVEL_NO_SPAWN = 0xffffffff;
+
+    // The most items a tile of a level file may hold, and how many bytes
+    // of items a file may ask for per byte of its own size. A file asking
+    // for more is taken to be corrupt, rather than left to exhaust memory.
+    static const std::uint64_t LEVEL_MAX_TILE_ITEMS = 1024;
+    static const std::uint64_t LEVEL_MAX_ITEM_BYTES_PER_BYTE = 4;
+
+    struct LevelFileSection
+    {
+        std::uint64_t offset;
+        std::uint64_t count;
+    };
+
+    struct LevelFileHeader
+    {
+        char             magic[8];
+        std::uint32_t    version;
+        std::uint32_t    byteOrder;
+        std::uint32_t    width;
+        std::uint32_t    height;
+        std::uint32_t    spawnX;
+        std::uint32_t    spawnY;
+        LevelFileSection planes;
+        LevelFileSection items;
+        LevelFileSection rooms;
+        LevelFileSection edges;
+        std::uint32_t    visibilityRadius;
+        std::uint32_t    reserved;
+        LevelFileSection visibility;
+    };
+
+    struct LevelFileItem
+    {
+        std::uint64_t tile;
+        std::uint64_t count;
+    };
+
+    struct LevelFileRoom
+    {
+        std::int32_t  left;
+        std::int32_t  top;
+        std::uint32_t width;
+        std::uint32_t height;
+    };
+
+    struct LevelFileEdge
+    {
+        std::uint32_t a;
+        std::uint32_t b;
+    };
+
+
+    /*
+     * readFile
+     *
+     * Get the contents of a file into memory, returning the block and its
+     * size. The block is at least 8 byte aligned.
+     */
+    static std::shared_ptr<void> readFile (const std::string &path,
+                                           std::size_t       *size)
+    {
+#ifndef _WIN32
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open level file " + path);
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            throw std::runtime_error("Failed to read level file " + path);
+        }
+        *size = static_cast<std::size_t>(st.st_size);
+
+        // A private mapping lets the game change the map (opening doors,
+        // marking tiles as seen) without the changes reaching the file.
+        void *data = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                          fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("Failed to map level file " + path);
+        }
+
+        std::size_t length = *size;
+        return std::shared_ptr<void>(data, [length](void *data) {
+                                         munmap(data, length);
+                                     });
+#else
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            throw std::runtime_error("Failed to open level file " + path);
+        }
+        *size = static_cast<std::size_t>(file.tellg());
+
+        std::shared_ptr<void> data(
+                    new std::uint64_t[(*size + 7) / 8],
+                    [](void *data) {
+                        delete[] static_cast<std::uint64_t *>(data);
+                    });
+        file.seekg(0);
+        if (!file.read(static_cast<char *>(data.get()), *size)) {
+            throw std::runtime_error("Failed to read level file " + path);
+        }
+        return data;
+#endif
+    }
+
+
+    /*
+     * checkSection
+     *
+     * Check that a section lies within the file and is suitably aligned.
+     */
+    static bool checkSection (const LevelFileSection &section,
+                              std::size_t             elementSize,
+                              std::size_t             fileSize)
+    {
+        return section.offset % 8 == 0 &&
+               section.offset <= fileSize &&
+               section.count <= (fileSize - section.offset) / elementSize;
+    }
+
+
+    void Map::Save(const std::string &path) const
+    {
+        std::size_t     item_count = m_items.size();
+        LevelFileHeader header;
+
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, LEVEL_MAGIC, sizeof(header.magic));
+        header.version = LEVEL_VERSION;
+        header.byteOrder = LEVEL_BYTE_ORDER;
+        header.width = m_width;
+        header.height = m_height;
+        if (!FindSpawn(&header.spawnX, &header.spawnY)) {
+            header.spawnX = header.spawnY = LEVEL_NO_SPAWN;
+        }
+
+        header.planes.offset = sizeof(header);
+        header.planes.count = StorageWords(m_tileCount);
+        header.items.offset = header.planes.offset +
+                              header.planes.count * sizeof(std::uint64_t);
+        header.items.count = item_count;
+        header.rooms.offset = header.items.offset +
+                              header.items.count * sizeof(LevelFileItem);
+        header.rooms.count = m_rooms.size();
+        header.edges.offset = header.rooms.offset +
+                              header.rooms.count * sizeof(LevelFileRoom);
+        header.edges.count = m_roomEdges.size();
+        header.visibilityRadius = m_visibilityRadius;
+        header.visibility.offset = header.edges.offset +
+                                   header.edges.count * sizeof(LevelFileEdge);
+        header.visibility.count = m_visibilityWords;
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(static_cast<const char *>(m_storage.get()),
+                   header.planes.count * sizeof(std::uint64_t));
+
+        for (auto &&tile : m_items) {
+            LevelFileItem item = { tile.first, tile.second.size() };
+            file.write(reinterpret_cast<const char *>(&item), sizeof(item));
+        }
+
+        for (auto &&room : m_rooms) {
+            LevelFileRoom file_room = {
+                room.Left(), room.Top(), room.Width(), room.Height()
+            };
+            file.write(reinterpret_cast<const char *>(&file_room),
+                       sizeof(file_room));
+        }
+
+        for (auto &&edge : m_roomEdges) {
+            LevelFileEdge file_edge = { edge.a, edge.b };
+            file.write(reinterpret_cast<const char *>(&file_edge),
+                       sizeof(file_edge));
+        }
+
+        file.write(static_cast<const char *>(m_visibilityStorage.get()),
+                   header.visibility.count * sizeof(std::uint64_t));
+
+        if (!file.flush()) {
+            throw std::runtime_error("Failed to write level file " + path);
+        }
+    }
+
+
+    std::shared_ptr<Map> Map::Load(const std::string &path)
+    {
+        std::size_t           size;
+        std::shared_ptr<void> data = readFile(path, &size);
+        const char           *base = static_cast<const char *>(data.get());
+        LevelFileHeader       header;
+
+        if (size < sizeof(header)) {
+            throw std::runtime_error("Not a level file: " + path);
+        }
+        std::memcpy(&header, base, sizeof(header));
+
+        if (std::memcmp(header.magic, LEVEL_MAGIC, sizeof(header.magic)) != 0 ||
+            header.byteOrder != LEVEL_BYTE_ORDER) {
+            throw std::runtime_error("Not a level file: " + path);
+        }
+
+        if (header.version != LEVEL_VERSION) {
+            throw std::runtime_error("Unsupported level file version: " + path);
+        }
+
+        std::size_t tiles = static_cast<std::size_t>(header.width) *
+                            header.height;
+        if (header.planes.count != StorageWords(tiles) ||
+            !checkSection(header.planes, sizeof(std::uint64_t), size) ||
+            !checkSection(header.items, sizeof(LevelFileItem), size) ||
+            !checkSection(header.rooms, sizeof(LevelFileRoom), size) ||
+            !checkSection(header.edges, sizeof(LevelFileEdge), size) ||
+            !checkSection(header.visibility, sizeof(std::uint64_t), size)) {
+            throw std::runtime_error("Corrupt level file: " + path);
+        }
+
+        auto map = std::make_shared<Map>(0, 0);
+        map->m_width = header.width;
+        map->m_height = header.height;
+        map->m_tileCount = tiles;
+
+        // The planes are used where they lie in the file, sharing ownership
+        // of the whole file.
+        map->BindPlanes(std::shared_ptr<void>(
+                            data,
+                            const_cast<char *>(base) + header.planes.offset));
+        map->m_visibleListed = false;
+
+        const LevelFileItem *items = reinterpret_cast<const LevelFileItem *>(
+                                        base + header.items.offset);
+        std::uint64_t        item_total = 0;
+        for (std::size_t i = 0; i < header.items.count; i++) {
+            if (items[i].tile >= tiles ||
+                items[i].count > LEVEL_MAX_TILE_ITEMS) {
+                throw std::runtime_error("Corrupt level file: " + path);
+            }
+            item_total += items[i].count;
+        }
+
+        if (item_total * sizeof(Item) >
+            size * LEVEL_MAX_ITEM_BYTES_PER_BYTE) {
+            throw std::runtime_error("Corrupt level file: " + path);
+        }
+
+        map->ReserveItems(item_total);
+        for (std::size_t i = 0; i < header.items.count; i++) {
+            for (std::uint64_t j = 0; j < items[i].count; j++) {
+                map->CreateItem(items[i].tile);
+            }
+        }
+
+        const LevelFileRoom *rooms = reinterpret_cast<const LevelFileRoom *>(
+                                        base + header.rooms.offset);
+        map->m_rooms.reserve(header.rooms.count);
+        for (std::size_t i = 0; i < header.rooms.count; i++) {
+            map->m_rooms.push_back(Room(rooms[i].left, rooms[i].top,
+                                        rooms[i].width, rooms[i].height));
+        }
+
+        const LevelFileEdge *edges = reinterpret_cast<const LevelFileEdge *>(
+                                        base + header.edges.offset);
+        map->m_roomEdges.reserve(header.edges.count);
+        for (std::size_t i = 0; i < header.edges.count; i++) {
+            if (edges[i].a >= header.rooms.count ||
+                edges[i].b >= header.rooms.count) {
+                throw std::runtime_error("Corrupt level file: " + path);
+            }
+            map->m_roomEdges.push_back(
+                graph::IndexedEdge(edges[i].a, edges[i].b));
+        }
+
+        // Like the planes, the visibility sets are used where they lie.
+        if (header.visibilityRadius != 0 &&
+            !map->BindVisibilitySets(
+                    std::shared_ptr<void>(
+                        data,
+                        const_cast<char *>(base) + header.visibility.offset),
+                    header.visibility.count, header.visibilityRadius)) {
+            throw std::runtime_error("Corrupt level file: " + path);
+        }
+
+        return map;
+    }
+}
@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+#include "pathfinder.hpp"
+
+
+namespace dungeon
+{
+    void PathFinder::Resize(unsigned int width, unsigned int height)
+    {
+        std::size_t count = static_cast<std::size_t>(width) * height;
+
+        m_width = width;
+        m_height = height;
+        m_generation = 0;
+        m_stamps.assign(count, 0);
+        m_costs.assign(count, 0);
+        m_parents.assign(count, 0);
+
+        // The open list can hold the same tile more than once, but a search
+        // rarely has more than a front across the grid open at a time, so
+        // start it at a few times the perimeter rather than a slot per tile.
+        // A search that needs more grows it, and it keeps that size after.
+        m_open.clear();
+        m_open.reserve(std::min<std::size_t>(
+                            count, 4 * (static_cast<std::size_t>(width) +
+                                        height)));
+    }
+
+
+    void PathFinder::NextGeneration()
+    {
+        if (++m_generation == 0) {
+            // The stamp has wrapped - clear the old stamps so that none of
+            // them match by accident.
+            std::fill(m_stamps.begin(), m_stamps.end(), 0);
+            m_generation = 1;
+        }
+    }
+
+
+    void PathFinder::Visit(std::uint32_t tile, std::uint32_t from, int cost,
+                           std::uint32_t goal)
+    {
+        if (m_stamps[tile] != m_generation || cost < m_costs[tile]) {
+            m_stamps[tile] = m_generation;
+            m_costs[tile] = cost;
+            m_parents[tile] = from;
+
+            m_open.emplace_back(Heuristic(tile, goal), tile);
+            std::push_heap(m_open.begin(), m_open.end(),
+                           std::greater<OpenEntry>());
+        }
+    }
+
+
+    bool PathFinder::FindAStarPath(std::uint32_t start, std::uint32_t goal)
+    {
+        m_stamps[start] = m_generation;
+        m_costs[start] = 0;
+        m_parents[start] = start;
+        m_open.emplace_back(0, start);
+
+        while (!m_open.empty()) {
+            std::pop_heap(m_open.begin(), m_open.end(),
+                          std::greater<OpenEntry>());
+            std::uint32_t current = m_open.back().second;
+            m_open.pop_back();
+            m_stats.expansions++;
+
+            if (current == goal) {
+                return true;
+            }
+
+            // Don't consider diagonal neighbours when creating paths so that
+            // diagonal paths are wider. The order here matters, as it breaks
+            // ties between equally good tiles.
+            unsigned int x = current % m_width;
+            unsigned int y = current / m_width;
+            int cost = m_costs[current] + 1;
+
+            if (x > 0) {
+                Visit(current - 1, current, cost, goal);
+            }
+            if (x < m_width - 1) {
+                Visit(current + 1, current, cost, goal);
+            }
+            if (y > 0) {
+                Visit(current - m_width, current, cost, goal);
+            }
+            if (y < m_height - 1) {
+                Visit(current + m_width, current, cost, goal);
+            }
+        }
+
+        return false;
+    }
+
+
+    bool PathFinder::Jump(std::uint32_t  tile,
+                          int            dx,
+                          int            dy,
+                          std::uint32_t  goal,
+                          std::uint32_t *jump_point) const
+    {
+        int x = static_cast<int>(tile % m_width);
+        int y = static_cast<int>(tile / m_width);
+        int goal_x = static_cast<int>(goal % m_width);
+        int goal_y = static_cast<int>(goal / m_width);
+
+        if (dx != 0) {
+            // Moving horizontally, every tile passed scans vertically, and a
+            // vertical scan can only stop at the goal. So the jump stops in
+            // the goal's column if that lies ahead, and otherwise runs into
+            // the edge of the map without finding anything.
+            if ((goal_x - x) * dx > 0) {
+                *jump_point = static_cast<std::uint32_t>(y) * m_width +
+                              static_cast<std::uint32_t>(goal_x);
+                return true;
+            }
+        } else if (x == goal_x && (goal_y - y) * dy > 0) {
+            // Moving vertically, there are no forced neighbours, so only the
+            // goal itself can stop the jump.
+            *jump_point = goal;
+            return true;
+        }
+
+        return false;
+    }
+
+
+    void PathFinder::AddJumpPoint(std::uint32_t tile, std::uint32_t from,
+                                  std::uint32_t goal)
+    {
+        int cost = m_costs[from] + Distance(from, tile);
+
+        if (m_stamps[tile] != m_generation || cost < m_costs[tile]) {
+            m_stamps[tile] = m_generation;
+            m_costs[tile] = cost;
+            m_parents[tile] = from;
+
+            m_open.emplace_back(cost + Distance(tile, goal), tile);
+            std::push_heap(m_open.begin(), m_open.end(),
+                           std::greater<OpenEntry>());
+        }
+    }
+
+
+    bool PathFinder::FindJumpPointPath(std::uint32_t start, std::uint32_t goal)
+    {
+        m_stamps[start] = m_generation;
+        m_costs[start] = 0;
+        m_parents[start] = start;
+        m_open.emplace_back(Distance(start, goal), start);
+
+        while (!m_open.empty()) {
+            std::pop_heap(m_open.begin(), m_open.end(),
+                          std::greater<OpenEntry>());
+            std::uint32_t current = m_open.back().second;
+            m_open.pop_back();
+            m_stats.expansions++;
+
+            if (current == goal) {
+                return true;
+            }
+
+            // Prune the directions to search using the direction we arrived
+            // from: moving horizontally continues horizontally and branches
+            // vertically, moving vertically only continues vertically. The
+            // start tile searches every direction.
+            std::uint32_t parent = m_parents[current];
+            int from_x = static_cast<int>(parent % m_width);
+            int from_y = static_cast<int>(parent / m_width);
+            int x = static_cast<int>(current % m_width);
+            int y = static_cast<int>(current / m_width);
+            int dx = x > from_x ? 1 : (x < from_x ? -1 : 0);
+            int dy = y > from_y ? 1 : (y < from_y ? -1 : 0);
+
+            const int directions[4][2] = {
+                { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 }
+            };
+
+            for (auto &&dir : directions) {
+                bool natural;
+                if (current == start) {
+                    natural = true;
+                } else if (dx != 0) {
+                    natural = dir[0] == dx || dir[0] == 0;
+                } else {
+                    natural = dir[1] == dy;
+                }
+
+                std::uint32_t jump_point;
+                if (natural && Jump(current, dir[0], dir[1], goal, &jump_point)) {
+                    AddJumpPoint(jump_point, current, goal);
+                }
+            }
+        }
+
+        return false;
+    }
+
+
+    void PathFinder::BuildPath(std::uint32_t start, std::uint32_t goal,
+                               Path &path) const
+    {
+        // Walk back along the parents, filling in the straight runs between
+        // jump points. For A* every parent is a neighbour, so there is
+        // nothing to fill.
+        std::uint32_t tile = goal;
+        while (tile != start) {
+            std::uint32_t parent = m_parents[tile];
+            int step;
+
+            if (parent / m_width == tile / m_width) {
+                step = parent > tile ? 1 : -1;
+            } else {
+                step = parent > tile ? static_cast<int>(m_width) :
+                                       -static_cast<int>(m_width);
+            }
+
+            for (tile += step; tile != parent; tile += step) {
+                path.push_back(tile);
+            }
+
+            if (parent != start) {
+                path.push_back(parent);
+            }
+        }
+    }
+
+
+    bool PathFinder::FindPath(std::uint32_t  start,
+                              std::uint32_t  goal,
+                              Path          &path)
+    {
+        auto start_time = std::chrono::steady_clock::now();
+
+        NextGeneration();
+        m_open.clear();
+        path.clear();
+
+        bool found;
+        if (m_method == JUMP_POINT) {
+            found = FindJumpPointPath(start, goal);
+        } else {
+            found = FindAStarPath(start, goal);
+        }
+
+        if (found) {
+            BuildPath(start, goal, path);
+        }
+
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start_time;
+        m_stats.searches++;
+        m_stats.seconds += elapsed.count();
+
+        return found;
+    }
+}
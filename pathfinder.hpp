@@ -0,0 +1,132 @@
+#ifndef __PATHFINDER_HPP__
+#define __PATHFINDER_HPP__
+
+
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+
+namespace dungeon
+{
+    /*
+     * PathFinder
+     *
+     * A reusable workspace for routing corridors across a grid with
+     * 4-neighbour moves, where every tile may be crossed at equal cost. The
+     * per-tile cost and parent arrays are indexed by tile index and are
+     * invalidated in O(1) between searches by bumping a generation stamp,
+     * and the open list keeps its storage, so once the workspace has warmed
+     * up a search does not allocate.
+     *
+     * Two search methods are available:
+     *  - A_STAR expands tiles one at a time in order of straight-line
+     *    distance to the goal, which gives staircase-shaped diagonal
+     *    corridors.
+     *  - JUMP_POINT is Jump Point Search adapted to 4-neighbour moves, which
+     *    only puts jump points on the open list. As every tile in the grid
+     *    can be crossed, no tile has forced neighbours and the only jump
+     *    points are those in line with the goal, so each jump is O(1). It
+     *    gives L-shaped corridors of the same (Manhattan) length.
+     */
+    class PathFinder
+    {
+        public:
+            // A path, as a list of tile indices.
+            using Path = std::vector<std::uint32_t>;
+
+            enum Method {
+                A_STAR,
+                JUMP_POINT
+            };
+
+            struct Stats
+            {
+                Stats() : searches(0), expansions(0), seconds(0) {}
+
+                unsigned long searches;
+                unsigned long expansions;
+                double        seconds;
+            };
+
+            PathFinder()
+                : m_width(0), m_height(0), m_method(A_STAR), m_generation(0)
+            {
+            }
+
+            // Size the workspace for a grid. Previous results are lost.
+            void Resize(unsigned int width, unsigned int height);
+
+            void SetMethod(Method method)
+            {
+                m_method = method;
+            }
+
+            // Find a path between two tile indices, storing the tiles
+            // strictly between them in path, ordered from goal to start.
+            // Returns false if there is no path.
+            bool FindPath(std::uint32_t  start,
+                          std::uint32_t  goal,
+                          Path          &path);
+
+            const Stats & GetStats() const
+            {
+                return m_stats;
+            }
+
+            void ResetStats()
+            {
+                m_stats = Stats();
+            }
+
+        private:
+            using OpenEntry = std::pair<int, std::uint32_t>;
+
+            int Heuristic(std::uint32_t tile, std::uint32_t goal) const
+            {
+                int x_diff = static_cast<int>(tile % m_width) -
+                             static_cast<int>(goal % m_width);
+                int y_diff = static_cast<int>(tile / m_width) -
+                             static_cast<int>(goal / m_width);
+                return x_diff * x_diff + y_diff * y_diff;
+            }
+
+            int Distance(std::uint32_t tile, std::uint32_t goal) const
+            {
+                int x_diff = static_cast<int>(tile % m_width) -
+                             static_cast<int>(goal % m_width);
+                int y_diff = static_cast<int>(tile / m_width) -
+                             static_cast<int>(goal / m_width);
+                return std::abs(x_diff) + std::abs(y_diff);
+            }
+
+            void NextGeneration();
+            void Visit(std::uint32_t tile, std::uint32_t from, int cost,
+                       std::uint32_t goal);
+            bool FindAStarPath(std::uint32_t start, std::uint32_t goal);
+            bool FindJumpPointPath(std::uint32_t start, std::uint32_t goal);
+            bool Jump(std::uint32_t  tile,
+                      int            dx,
+                      int            dy,
+                      std::uint32_t  goal,
+                      std::uint32_t *jump_point) const;
+            void AddJumpPoint(std::uint32_t tile, std::uint32_t from,
+                              std::uint32_t goal);
+            void BuildPath(std::uint32_t start, std::uint32_t goal,
+                           Path &path) const;
+
+            unsigned int               m_width;
+            unsigned int               m_height;
+            Method                     m_method;
+            std::uint32_t              m_generation;
+            std::vector<std::uint32_t> m_stamps;
+            std::vector<int>           m_costs;
+            std::vector<std::uint32_t> m_parents;
+            std::vector<OpenEntry>     m_open;
+            Stats                      m_stats;
+    };
+}
+
+
+#endif
@@ -2,8 +2,8 @@
 #define __PLAYER_HPP__
 
 
-#include <algorithm>
-#include <iterator>
+#include <memory>
+#include <unordered_set>
 #include "item.hpp"
 
 
@@ -12,10 +12,19 @@ namespace dungeon
     class Player
     {
         public:
-            void AddItems(ItemVector::iterator first,
-                          ItemVector::iterator last)
+            // Take items from a level. The player holds on to the level's
+            // item arena, rather than to each item, so the items outlive the
+            // level.
+            void AddItems(ItemVector::const_iterator        first,
+                          ItemVector::const_iterator        last,
+                          const std::shared_ptr<ItemArena> &arena)
             {
-                std::copy(first, last, std::back_inserter(m_items));
+                if (first == last) {
+                    return;
+                }
+
+                m_arenas.insert(arena);
+                m_items.insert(m_items.end(), first, last);
             }
 
             // TODO: Encapsulate these properly
@@ -23,7 +32,8 @@ namespace dungeon
             unsigned int y;
 
         private:
-            ItemVector   m_items;
+            ItemVector                                     m_items;
+            std::unordered_set<std::shared_ptr<ItemArena>> m_arenas;
     };
 }
 
@@ -0,0 +1,281 @@
+#include <cmath>
+
+#include "graph.hpp"
+
+
+/*
+ * Exact predicates
+ *
+ * orient2d and incircle are signs of determinants that rounding can get
+ * wrong when the points are close to collinear or cocircular. Here they are
+ * worked out exactly using Shewchuk's expansion arithmetic: a value is held
+ * as the sum of doubles, ordered by increasing magnitude, that do not
+ * overlap, and sums and products are formed without rounding. The sign of
+ * an expansion is the sign of its largest component.
+ */
+namespace graph
+{
+    // Enough for the largest expansion the predicates build: the incircle
+    // determinant is the sum of three products of 16 component expansions.
+    static const int MAX_PRODUCT = 512;
+    static const int MAX_EXPANSION = 3 * MAX_PRODUCT;
+
+
+    static inline void twoSum(double a, double b, double &x, double &y)
+    {
+        x = a + b;
+        double bVirtual = x - a;
+        double aVirtual = x - bVirtual;
+        y = (a - aVirtual) + (b - bVirtual);
+    }
+
+
+    static inline void fastTwoSum(double a, double b, double &x, double &y)
+    {
+        x = a + b;
+        y = b - (x - a);
+    }
+
+
+    static inline void twoProduct(double a, double b, double &x, double &y)
+    {
+        x = a * b;
+        y = std::fma(a, b, -x);
+    }
+
+
+    /*
+     * difference
+     *
+     * a - b as a two component expansion.
+     */
+    static int difference(double a, double b, double *h)
+    {
+        twoSum(a, -b, h[1], h[0]);
+        return 2;
+    }
+
+
+    /*
+     * sumExpansions
+     *
+     * h = e + f, eliminating zero components. h must not overlap e or f.
+     */
+    static int sumExpansions(int eLen, const double *e, int fLen,
+                             const double *f, double *h)
+    {
+        int    eIndex = 0;
+        int    fIndex = 0;
+        int    hIndex = 0;
+        double q;
+        double qNew;
+        double hh;
+
+        // Merge the components by increasing magnitude, carrying the sum so
+        // far in q.
+        auto takeE = [&]() {
+            return fIndex == fLen ||
+                   (eIndex < eLen &&
+                    (f[fIndex] > e[eIndex]) == (f[fIndex] > -e[eIndex]));
+        };
+
+        if (takeE()) {
+            q = e[eIndex++];
+        } else {
+            q = f[fIndex++];
+        }
+
+        if (eIndex < eLen && fIndex < fLen) {
+            if (takeE()) {
+                fastTwoSum(e[eIndex++], q, qNew, hh);
+            } else {
+                fastTwoSum(f[fIndex++], q, qNew, hh);
+            }
+            q = qNew;
+            if (hh != 0.0) {
+                h[hIndex++] = hh;
+            }
+        }
+
+        while (eIndex < eLen || fIndex < fLen) {
+            if (takeE()) {
+                twoSum(q, e[eIndex++], qNew, hh);
+            } else {
+                twoSum(q, f[fIndex++], qNew, hh);
+            }
+            q = qNew;
+            if (hh != 0.0) {
+                h[hIndex++] = hh;
+            }
+        }
+
+        if (q != 0.0 || hIndex == 0) {
+            h[hIndex++] = q;
+        }
+        return hIndex;
+    }
+
+
+    /*
+     * scaleExpansion
+     *
+     * h = e * b, eliminating zero components. h must not overlap e.
+     */
+    static int scaleExpansion(int eLen, const double *e, double b, double *h)
+    {
+        int    hIndex = 0;
+        double q;
+        double hh;
+
+        twoProduct(e[0], b, q, hh);
+        if (hh != 0.0) {
+            h[hIndex++] = hh;
+        }
+
+        for (int i = 1; i < eLen; i++) {
+            double product1;
+            double product0;
+            double sum;
+
+            twoProduct(e[i], b, product1, product0);
+            twoSum(q, product0, sum, hh);
+            if (hh != 0.0) {
+                h[hIndex++] = hh;
+            }
+            fastTwoSum(product1, sum, q, hh);
+            if (hh != 0.0) {
+                h[hIndex++] = hh;
+            }
+        }
+
+        if (q != 0.0 || hIndex == 0) {
+            h[hIndex++] = q;
+        }
+        return hIndex;
+    }
+
+
+    /*
+     * multiplyExpansions
+     *
+     * h = e * f, as the sum of e scaled by each component of f. The product
+     * can have up to 2 * eLen * fLen components, which must be no more than
+     * MAX_PRODUCT.
+     */
+    static int multiplyExpansions(int eLen, const double *e, int fLen,
+                                  const double *f, double *h)
+    {
+        double scaled[2 * 16];
+        double partial[2][MAX_PRODUCT];
+        int    length = scaleExpansion(eLen, e, f[0], partial[0]);
+        int    current = 0;
+
+        for (int i = 1; i < fLen; i++) {
+            int scaledLen = scaleExpansion(eLen, e, f[i], scaled);
+            length = sumExpansions(length, partial[current], scaledLen, scaled,
+                                   partial[1 - current]);
+            current = 1 - current;
+        }
+
+        for (int i = 0; i < length; i++) {
+            h[i] = partial[current][i];
+        }
+        return length;
+    }
+
+
+    static int negateExpansion(int eLen, double *e)
+    {
+        for (int i = 0; i < eLen; i++) {
+            e[i] = -e[i];
+        }
+        return eLen;
+    }
+
+
+    /*
+     * crossProduct
+     *
+     * h = a * b - c * d for two component expansions, with up to 16
+     * components.
+     */
+    static int crossProduct(const double *a, const double *b,
+                            const double *c, const double *d, double *h)
+    {
+        double ab[8];
+        double cd[8];
+        int    abLen = multiplyExpansions(2, a, 2, b, ab);
+        int    cdLen = negateExpansion(multiplyExpansions(2, c, 2, d, cd), cd);
+
+        return sumExpansions(abLen, ab, cdLen, cd, h);
+    }
+
+
+    /*
+     * lift
+     *
+     * h = x * x + y * y for two component expansions, with up to 16
+     * components.
+     */
+    static int lift(const double *x, const double *y, double *h)
+    {
+        double xx[8];
+        double yy[8];
+        int    xxLen = multiplyExpansions(2, x, 2, x, xx);
+        int    yyLen = multiplyExpansions(2, y, 2, y, yy);
+
+        return sumExpansions(xxLen, xx, yyLen, yy, h);
+    }
+
+
+    double orient2dExact(const Vec2f &a, const Vec2f &b, const Vec2f &c)
+    {
+        double acx[2], acy[2], bcx[2], bcy[2];
+        difference(a.x, c.x, acx);
+        difference(a.y, c.y, acy);
+        difference(b.x, c.x, bcx);
+        difference(b.y, c.y, bcy);
+
+        double det[16];
+        int    detLen = crossProduct(acx, bcy, acy, bcx, det);
+
+        return det[detLen - 1];
+    }
+
+
+    double incircleExact(const Vec2f &a, const Vec2f &b, const Vec2f &c,
+                         const Vec2f &d)
+    {
+        double adx[2], ady[2], bdx[2], bdy[2], cdx[2], cdy[2];
+        difference(a.x, d.x, adx);
+        difference(a.y, d.y, ady);
+        difference(b.x, d.x, bdx);
+        difference(b.y, d.y, bdy);
+        difference(c.x, d.x, cdx);
+        difference(c.y, d.y, cdy);
+
+        // Each lifted point times the cross product of the other two.
+        double aLift[16], bLift[16], cLift[16];
+        double bc[16], ca[16], ab[16];
+        int    aLiftLen = lift(adx, ady, aLift);
+        int    bLiftLen = lift(bdx, bdy, bLift);
+        int    cLiftLen = lift(cdx, cdy, cLift);
+        int    bcLen = crossProduct(bdx, cdy, cdx, bdy, bc);
+        int    caLen = crossProduct(cdx, ady, adx, cdy, ca);
+        int    abLen = crossProduct(adx, bdy, bdx, ady, ab);
+
+        double aTerm[MAX_PRODUCT], bTerm[MAX_PRODUCT], cTerm[MAX_PRODUCT];
+        int    aTermLen = multiplyExpansions(aLiftLen, aLift, bcLen, bc, aTerm);
+        int    bTermLen = multiplyExpansions(bLiftLen, bLift, caLen, ca, bTerm);
+        int    cTermLen = multiplyExpansions(cLiftLen, cLift, abLen, ab, cTerm);
+
+        double abTerms[2 * MAX_PRODUCT];
+        double det[MAX_EXPANSION];
+        int    abTermsLen = sumExpansions(aTermLen, aTerm, bTermLen, bTerm,
+                                          abTerms);
+        int    detLen = sumExpansions(abTermsLen, abTerms, cTermLen, cTerm,
+                                      det);
+
+        return det[detLen - 1];
+    }
+}
@@ -0,0 +1,145 @@
+#include <algorithm>
+
+#include "roomgrid.hpp"
+
+
+namespace dungeon
+{
+    void RoomGrid::Reset(int          left,
+                         int          top,
+                         unsigned int width,
+                         unsigned int height,
+                         unsigned int cellSize)
+    {
+        m_left = left;
+        m_top = top;
+        m_cellSize = std::max(1u, cellSize);
+        m_columns = std::max(1u, (width + m_cellSize - 1) / m_cellSize);
+        m_rows = std::max(1u, (height + m_cellSize - 1) / m_cellSize);
+
+        m_cells.assign(m_columns * m_rows, std::vector<unsigned int>());
+        m_stamps.clear();
+        m_queryStamp = 0;
+    }
+
+
+    unsigned int RoomGrid::CellColumn(int x) const
+    {
+        if (x <= m_left) {
+            return 0;
+        }
+
+        unsigned int column = static_cast<unsigned int>(x - m_left) / m_cellSize;
+        return std::min(column, m_columns - 1);
+    }
+
+
+    unsigned int RoomGrid::CellRow(int y) const
+    {
+        if (y <= m_top) {
+            return 0;
+        }
+
+        unsigned int row = static_cast<unsigned int>(y - m_top) / m_cellSize;
+        return std::min(row, m_rows - 1);
+    }
+
+
+    RoomGrid::CellRange RoomGrid::CellsFor(const Room &room) const
+    {
+        // Right and bottom are exclusive, so the last tile covered is one
+        // before them. Rooms never have zero size, but be safe.
+        CellRange range;
+        range.left = CellColumn(room.Left());
+        range.top = CellRow(room.Top());
+        range.right = CellColumn(std::max(room.Left(), room.Right() - 1));
+        range.bottom = CellRow(std::max(room.Top(), room.Bottom() - 1));
+        return range;
+    }
+
+
+    void RoomGrid::RemoveFromCell(unsigned int cell, unsigned int id)
+    {
+        auto &ids = m_cells[cell];
+        auto iter = std::find(ids.begin(), ids.end(), id);
+        if (iter != ids.end()) {
+            *iter = ids.back();
+            ids.pop_back();
+        }
+    }
+
+
+    void RoomGrid::Insert(unsigned int id, const Room &room)
+    {
+        if (id >= m_stamps.size()) {
+            m_stamps.resize(id + 1, 0);
+        }
+
+        CellRange range = CellsFor(room);
+        for (unsigned int y = range.top; y <= range.bottom; y++) {
+            for (unsigned int x = range.left; x <= range.right; x++) {
+                Cell(x, y).push_back(id);
+            }
+        }
+    }
+
+
+    void RoomGrid::Remove(unsigned int id, const Room &room)
+    {
+        CellRange range = CellsFor(room);
+        for (unsigned int y = range.top; y <= range.bottom; y++) {
+            for (unsigned int x = range.left; x <= range.right; x++) {
+                RemoveFromCell(y * m_columns + x, id);
+            }
+        }
+    }
+
+
+    void RoomGrid::Move(unsigned int id, const Room &from, const Room &to)
+    {
+        CellRange old_range = CellsFor(from);
+        CellRange new_range = CellsFor(to);
+
+        for (unsigned int y = old_range.top; y <= old_range.bottom; y++) {
+            for (unsigned int x = old_range.left; x <= old_range.right; x++) {
+                if (!new_range.Contains(x, y)) {
+                    RemoveFromCell(y * m_columns + x, id);
+                }
+            }
+        }
+
+        for (unsigned int y = new_range.top; y <= new_range.bottom; y++) {
+            for (unsigned int x = new_range.left; x <= new_range.right; x++) {
+                if (!old_range.Contains(x, y)) {
+                    Cell(x, y).push_back(id);
+                }
+            }
+        }
+    }
+
+
+    void RoomGrid::Query(const Room &area, std::vector<unsigned int> &ids)
+    {
+        ids.clear();
+
+        if (++m_queryStamp == 0) {
+            // The stamp has wrapped, so old stamps could match - start afresh.
+            std::fill(m_stamps.begin(), m_stamps.end(), 0);
+            m_queryStamp = 1;
+        }
+
+        CellRange range = CellsFor(area);
+        for (unsigned int y = range.top; y <= range.bottom; y++) {
+            for (unsigned int x = range.left; x <= range.right; x++) {
+                for (auto id : Cell(x, y)) {
+                    if (m_stamps[id] != m_queryStamp) {
+                        m_stamps[id] = m_queryStamp;
+                        ids.push_back(id);
+                    }
+                }
+            }
+        }
+
+        std::sort(ids.begin(), ids.end());
+    }
+}
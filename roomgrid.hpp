@@ -0,0 +1,89 @@
+#ifndef __ROOMGRID_HPP__
+#define __ROOMGRID_HPP__
+
+
+#include <vector>
+
+#include "room.hpp"
+
+
+namespace dungeon
+{
+    /*
+     * RoomGrid
+     *
+     * A uniform grid over room rectangles, for finding the rooms that might
+     * intersect a given area without scanning every room. Rooms are
+     * identified by an index chosen by the caller. Rooms that stray outside
+     * the area covered by the grid are filed in the nearest edge cells, so
+     * lookups stay correct (if slower) for rooms out of bounds.
+     */
+    class RoomGrid
+    {
+        public:
+            RoomGrid()
+                : m_left(0), m_top(0), m_cellSize(1), m_columns(0), m_rows(0),
+                  m_queryStamp(0)
+            {
+            }
+
+            // Reset the grid to cover the given area, with no rooms in it.
+            void Reset(int          left,
+                       int          top,
+                       unsigned int width,
+                       unsigned int height,
+                       unsigned int cellSize);
+
+            void Insert(unsigned int id, const Room &room);
+            void Remove(unsigned int id, const Room &room);
+
+            // Update the grid after a room has moved from one position to
+            // another. Only the cells that the room has entered or left are
+            // touched.
+            void Move(unsigned int id, const Room &from, const Room &to);
+
+            // Find the ids of all rooms whose cells overlap the given area.
+            // Each id is reported once, in ascending order. The results are
+            // candidates only - they still need an exact intersection test.
+            void Query(const Room &area, std::vector<unsigned int> &ids);
+
+        private:
+            struct CellRange
+            {
+                unsigned int left;
+                unsigned int top;
+                unsigned int right;
+                unsigned int bottom;
+
+                bool Contains(unsigned int x, unsigned int y) const
+                {
+                    return x >= left && x <= right && y >= top && y <= bottom;
+                }
+            };
+
+            CellRange CellsFor(const Room &room) const;
+            unsigned int CellColumn(int x) const;
+            unsigned int CellRow(int y) const;
+            void RemoveFromCell(unsigned int cell, unsigned int id);
+
+            std::vector<unsigned int> & Cell(unsigned int column,
+                                             unsigned int row)
+            {
+                return m_cells[row * m_columns + column];
+            }
+
+            int                                    m_left;
+            int                                    m_top;
+            unsigned int                           m_cellSize;
+            unsigned int                           m_columns;
+            unsigned int                           m_rows;
+            std::vector<std::vector<unsigned int>> m_cells;
+
+            // Per-id stamps, used to report each id once per query.
+            std::vector<unsigned int>              m_stamps;
+            unsigned int                           m_queryStamp;
+    };
+}
+
+
+#endif
@@ -0,0 +1,128 @@
+#include <algorithm>
+
+#include "threadpool.hpp"
+
+
+namespace util
+{
+    ThreadPool::ThreadPool(unsigned int threads)
+        : m_job(NULL), m_count(0), m_next(0), m_busy(0), m_generation(0),
+          m_stop(false)
+    {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        for (unsigned int i = 1; i < threads; i++) {
+            m_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+        }
+    }
+
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_startCv.notify_all();
+
+        for (auto &&worker : m_workers) {
+            worker.join();
+        }
+    }
+
+
+    void ThreadPool::RunJob()
+    {
+        for (;;) {
+            std::size_t i = m_next.fetch_add(1);
+            if (i >= m_count) {
+                break;
+            }
+
+            try {
+                (*m_job)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_error) {
+                    m_error = std::current_exception();
+                }
+
+                // Stop handing out further indices.
+                m_next = m_count;
+            }
+        }
+    }
+
+
+    void ThreadPool::WorkerLoop()
+    {
+        unsigned int generation = 0;
+
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_startCv.wait(lock, [this, generation] {
+                    return m_stop || m_generation != generation;
+                });
+
+                if (m_stop) {
+                    return;
+                }
+                generation = m_generation;
+            }
+
+            RunJob();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (--m_busy == 0) {
+                    m_doneCv.notify_one();
+                }
+            }
+        }
+    }
+
+
+    void ThreadPool::ParallelFor(std::size_t                               count,
+                                 const std::function<void(std::size_t)>  &fn)
+    {
+        if (count == 0) {
+            return;
+        }
+
+        if (m_workers.empty() || count == 1) {
+            for (std::size_t i = 0; i < count; i++) {
+                fn(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_job = &fn;
+            m_count = count;
+            m_next = 0;
+            m_busy = static_cast<unsigned int>(m_workers.size());
+            m_error = nullptr;
+            m_generation++;
+        }
+        m_startCv.notify_all();
+
+        RunJob();
+
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_doneCv.wait(lock, [this] { return m_busy == 0; });
+            m_job = NULL;
+            error = m_error;
+            m_error = nullptr;
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef __THREADPOOL_HPP__
+#define __THREADPOOL_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util {
+    /*
+     * ThreadPool
+     *
+     * A fixed set of worker threads for running data-parallel loops. The
+     * thread calling ParallelFor takes part in the loop, so a pool of N
+     * threads runs N - 1 workers.
+     */
+    class ThreadPool
+    {
+        public:
+            // A thread count of 0 means one thread per hardware thread.
+            explicit ThreadPool(unsigned int threads = 0);
+            ~ThreadPool();
+
+            ThreadPool(const ThreadPool &) = delete;
+            ThreadPool & operator = (const ThreadPool &) = delete;
+
+            unsigned int Size() const
+            {
+                return static_cast<unsigned int>(m_workers.size()) + 1;
+            }
+
+            // Call fn(i) for every i in [0, count), spread across the pool,
+            // and wait for all calls to return. Indices are handed out
+            // dynamically, so the order in which they run is unspecified.
+            // The first exception thrown by fn is rethrown here. Only one
+            // thread may run a loop on a given pool at a time.
+            void ParallelFor(std::size_t                               count,
+                             const std::function<void(std::size_t)>  &fn);
+
+        private:
+            void WorkerLoop();
+            void RunJob();
+
+            std::vector<std::thread>                 m_workers;
+            std::mutex                               m_mutex;
+            std::condition_variable                  m_startCv;
+            std::condition_variable                  m_doneCv;
+            const std::function<void(std::size_t)>  *m_job;
+            std::size_t                              m_count;
+            std::atomic<std::size_t>                 m_next;
+            unsigned int                             m_busy;
+            unsigned int                             m_generation;
+            bool                                     m_stop;
+            std::exception_ptr                       m_error;
+    };
+}
+
+#endif /* __THREADPOOL_HPP__ */